@@ -35,242 +35,247 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-// debug stuff
+// debug stuff (can be overridden from the command line, e.g. to benchmark against the branchy reference)
+#ifndef LRUCACHE8_DEBUG_DISABLE_BRANCH_FREE_LRU
 #define LRUCACHE8_DEBUG_DISABLE_BRANCH_FREE_LRU 0
+#endif
 
 // Is compiler is C++11 or newer?
-#define LRUCACHE8_CPP11 (__cplusplus >= 201103L) || (_MSC_VER >= 1600)
+#define LRUCACHE8_CPP11 ((__cplusplus >= 201103L) || (_MSC_VER >= 1600))
 
-// Use C++11 native 'hash' and 'equal_to' functions as defaults. 
-// These provides better support for STL data types (but is platform-dependent).
-#define LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS (LRUCACHE8_CPP11 && 1)
+// Is the compiler C++17 or newer? (std::string_view lookups for lru8_fixed_string)
+#define LRUCACHE8_CPP17 ((__cplusplus >= 201703L) || (_MSVC_LANG >= 201703L))
 
-#if !LRUCACHE8_DEBUG_DISABLE_BRANCH_FREE_LRU && defined (LRUCACHE8_ENABLE_INTRINSICS) && defined (_MSC_VER)
-#define LRUCACHE8_USE_INTRINSICS 
+// Use C++11 native 'hash' and 'equal_to' functions as defaults instead of LRU8Hash and LRU8EqualTo.
+// std::hash is platform-dependent, and often the identity for integers and pointers, which leaves
+// aligned keys with only a few distinct way tags (and long probes).
+#ifndef LRUCACHE8_USE_STD_HASH
+#define LRUCACHE8_USE_STD_HASH 0
 #endif
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
-#include <stdint.h>
+#define LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS (LRUCACHE8_CPP11 && LRUCACHE8_USE_STD_HASH)
 
-#ifdef LRUCACHE8_USE_INTRINSICS
-#include <intrin.h>
-#define _lc8_nlz __lzcnt64
+#if !LRUCACHE8_DEBUG_DISABLE_BRANCH_FREE_LRU && defined (LRUCACHE8_ENABLE_INTRINSICS) && defined (_MSC_VER)
+#define LRUCACHE8_USE_INTRINSICS 
 #endif
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
-#if LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS
+// Bit scans (lru8_swar::byte_index and bit_index, which find the LRU row, a matching way, ...),
+// selected at compile time, or from the command line with e.g. -DLRUCACHE8_BITSCAN=0:
+//  LRUCACHE8_BITSCAN_TABLE     multiply + lookup table, portable
+//  LRUCACHE8_BITSCAN_BUILTIN   GCC / Clang builtins: bsf or tzcnt (BMI1) on x86, clz on ARM
+//  LRUCACHE8_BITSCAN_STD       C++20 std::countr_zero
+//  LRUCACHE8_BITSCAN_MSVC      __lzcnt64 / _BitScanForward (with LRUCACHE8_ENABLE_INTRINSICS)
+#define LRUCACHE8_BITSCAN_TABLE 0
+#define LRUCACHE8_BITSCAN_BUILTIN 1
+#define LRUCACHE8_BITSCAN_STD 2
+#define LRUCACHE8_BITSCAN_MSVC 3
+
+#ifndef LRUCACHE8_BITSCAN
+#if defined (LRUCACHE8_USE_INTRINSICS)
+#define LRUCACHE8_BITSCAN LRUCACHE8_BITSCAN_MSVC
+#elif defined (__GNUC__) || defined (__clang__)
+#define LRUCACHE8_BITSCAN LRUCACHE8_BITSCAN_BUILTIN
+#elif (__cplusplus >= 202002L) || (_MSVC_LANG >= 202002L)
+#define LRUCACHE8_BITSCAN LRUCACHE8_BITSCAN_STD
+#else
+#define LRUCACHE8_BITSCAN LRUCACHE8_BITSCAN_TABLE
+#endif
+#endif
 
-#include <functional>
+// Vector paths for the 16- and 32-way matrices and tags (see lru8_ways)
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define LRUCACHE8_USE_SSE2
+#endif
 
-template<typename _Key, typename _Val, typename _KeyHash = std::hash<_Key>, typename _KeyEqual = std::equal_to<_Key> >
+#if defined (LRUCACHE8_USE_SSE2) && defined (__AVX2__)
+#define LRUCACHE8_USE_AVX2
+#endif
 
+// Start each lru_cache8 on a cache line, so the tags, replacement state and hashes at its
+// head share one line. Only where 'new' honours over-alignment (C++17), as lru_cache_sa
+// allocates its sets with new [].
+#if defined (__cpp_aligned_new) && (__cpp_aligned_new >= 201606L)
+#define LRUCACHE8_ALIGN_LINE alignas (64)
 #else
+#define LRUCACHE8_ALIGN_LINE
+#endif
 
-#include <string>
+// Let empty members (the default hasher, equality, statistics, expiry and eviction policies)
+// share their address with the others, so they add nothing to a set. GCC and Clang honour the
+// attribute in any C++11 mode; elsewhere (C++03, older compilers) each still takes a byte.
+#if LRUCACHE8_CPP11 && defined (_MSC_VER) && !defined (__clang__) && (_MSC_VER >= 1929)
+#define LRUCACHE8_USE_NO_UNIQUE_ADDRESS
+#define LRUCACHE8_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#elif LRUCACHE8_CPP11 && defined (__has_cpp_attribute)
+#if __has_cpp_attribute (no_unique_address)
+#define LRUCACHE8_USE_NO_UNIQUE_ADDRESS
+#define LRUCACHE8_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+#endif
+
+#ifndef LRUCACHE8_NO_UNIQUE_ADDRESS
+#define LRUCACHE8_NO_UNIQUE_ADDRESS
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-uint32_t LC8Hash_DJBX33X (const unsigned char *src, size_t sz)
-{
-  uint32_t hash = 5381;
-  for (size_t i = 0; i < sz; ++i) { hash = ((hash << 5) + hash) ^ src [i]; }
-  return hash;
-}
-
-template<typename _Key> struct LRU8HashBitwise
-{
-  uint32_t operator() (const _Key &k) const
-  {
-    return LC8Hash_DJBX33X (reinterpret_cast<const unsigned char *>(&k), sizeof (_Key));
-  }
-};
-
-template<typename _Key> struct LRU8HashNumeric
-{
-  uint32_t operator() (_Key k) const
-  {
-    return static_cast<uint32_t>(k);
-  }
-};
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <functional>
+#include <string>
 
 #if LRUCACHE8_CPP11
+#include <atomic>
+#include <new>
 #include <type_traits>
-template<typename _Key> struct LRU8Hash : public LRU8HashBitwise<_Key>
-{
-  static_assert (std::is_enum<_Key>::value, "No default LRU8Hash available for this type");
-};
-#else
-template<typename _Key> struct LRU8Hash
-{
-};
+#include <utility>
 #endif
 
-template<> struct LRU8Hash<char> : public LRU8HashNumeric<char> {};
-template<> struct LRU8Hash<unsigned char> : public LRU8HashNumeric<unsigned char> {};
-template<> struct LRU8Hash<short> : public LRU8HashNumeric<short> {};
-template<> struct LRU8Hash<unsigned short> : public LRU8HashNumeric<unsigned short> {};
-template<> struct LRU8Hash<int> : public LRU8HashNumeric<int> {};
-template<> struct LRU8Hash<unsigned int> : public LRU8HashNumeric<unsigned int> {};
-template<> struct LRU8Hash<long> : public LRU8HashBitwise<long> {};
-template<> struct LRU8Hash<unsigned long> : public LRU8HashBitwise<unsigned long> {};
-template<> struct LRU8Hash<long long> : public LRU8HashBitwise<long long> {};
-template<> struct LRU8Hash<unsigned long long> : public LRU8HashBitwise<unsigned long long> {};
-template<> struct LRU8Hash<std::string>
-{
-  uint32_t operator() (const std::string &k) const
-  {
-    return LC8Hash_DJBX33X (reinterpret_cast<const unsigned char *>(k.c_str ()), k.size ());
-  }
-};
-
-template<typename _Key> struct LRU8Hash<_Key *>
-{
-  uint32_t operator() (_Key *k) const 
-  { 
-    return static_cast<uint32_t>(reinterpret_cast<size_t>(k)); 
-  }
-};
-
-template<typename _Key> struct LRU8EqualTo
-{
-  bool operator() (const _Key &k1, const _Key &k2) const 
-  { 
-    return (k1 == k2); 
-  }
-};
+#if LRUCACHE8_CPP17
+#include <string_view>
+#endif
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////
+#if LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_MSVC
+#include <intrin.h>
+#define _lc8_nlz __lzcnt64
+#elif LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_STD
+#include <bit>
+#endif
 
-template<typename _Key, typename _Val, typename _KeyHash = LRU8Hash<_Key>, typename _KeyEqual = LRU8EqualTo<_Key> >
+#if defined (LRUCACHE8_USE_AVX2)
+#include <immintrin.h>
+#elif defined (LRUCACHE8_USE_SSE2)
+#include <emmintrin.h>
+#endif
 
+#if defined (__GNUC__) || defined (__clang__)
+#define _lc8_prefetch(p) __builtin_prefetch (p)
+#elif defined (LRUCACHE8_USE_SSE2)
+#define _lc8_prefetch(p) _mm_prefetch (reinterpret_cast<const char *>(p), _MM_HINT_T0)
+#else
+#define _lc8_prefetch(p) ((void) (p))
 #endif
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-class lru_cache8
-{
-private:
-
-  static const uint8_t MAX_SIZE = sizeof (uint64_t);
-  static const uint8_t MAX_SIZE_MINUS_1 = MAX_SIZE - 1;
-  static const uint8_t IDX_INVALID = 0xff;
+// Byte-parallel helpers on a 64-bit word, shared by the reference matrix (one row per byte)
+// and the way fingerprints (one tag per byte).
 
-  struct node_t
+struct lru8_swar
+{
+  static uint64_t broadcast (uint8_t b)
   {
-    _Key      m_key;
-    _Val      m_val;
-    uint32_t  m_hash;
-
-    void set (const _Key &key, const _Val &val, uint32_t hash)
-    {
-      m_key = key;
-      m_val = val;
-      m_hash = hash;
-    }
-
-    node_t () : m_hash (0) {}
-  };
-
-public:
+    return 0x0101010101010101ull * b;
+  }
 
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
 
-  void write (const _Key &key, const _Val &val)
+  static uint64_t zero_bytes (uint64_t m)
   {
-    uint32_t h = (uint32_t) this->m_khash (key);
-    uint8_t  i = h & MAX_SIZE_MINUS_1; // optimized form of [h % MAX_SIZE]
-    uint8_t idx = m_lmap [i];
-
-    uint8_t lru_idx = this->get_matrix_lru ();
-    while ((idx != IDX_INVALID) && (idx != lru_idx))
-    {
-      // if key exists, update value
-      node_t *n = &m_node [idx];
-      if ((n->m_hash == h) && this->m_kequal (n->m_key, key))
-      {
-        n->m_val = val;
-        this->set_matrix_mru (idx);
-        return;
-      }
-
-      // probe next slot
-      i = (i + 1) & MAX_SIZE_MINUS_1;
-      idx = m_lmap [i];
-    }
-
-    m_lmap [i] = lru_idx;
-    m_node [lru_idx].set (key, val, h);
-    this->set_matrix_mru (lru_idx);
+    static const uint64_t c = 0x7f7f7f7f7f7f7f7f;
+    uint64_t y = (m & c) + c;
+    return ~(y | m | c);                      // convert 0-bytes to 0x80 and non-0-bytes to 0x00
   }
 
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
 
-  bool read (const _Key &key, _Val *val)
+  static uint8_t byte_index (uint64_t y)      // 'y' must have exactly one 0x80 byte
   {
-    uint32_t h = (uint32_t) this->m_khash (key);
-    uint8_t  i = h & MAX_SIZE_MINUS_1;
-    uint8_t idx = m_lmap [i];
-
-    uint8_t c = 0;
-    while ((idx != IDX_INVALID) && (c++ < MAX_SIZE))
+#if LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_MSVC
+    uint64_t n = _lc8_nlz (y);                // number of leading zero bits from the right
+    uint8_t r = static_cast<uint8_t>(n >> 3); // convert bit count to byte count
+    return 7u - r;                            // reverse index position to the left
+#elif (LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_BUILTIN) && (defined (__aarch64__) || defined (__arm__))
+    // the one set bit is bit 8i + 7, so a single clz finds i (ARM has no ctz instruction)
+    return static_cast<uint8_t>(7 - (__builtin_clzll (y) >> 3));
+#elif LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_BUILTIN
+    return static_cast<uint8_t>(__builtin_ctzll (y) >> 3);
+#elif LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_STD
+    return static_cast<uint8_t>(std::countr_zero (y) >> 3);
+#else    
+    static const uint8_t nlzlut [128] =
     {
-      node_t *n = &m_node [idx];
-      if ((n->m_hash == h) && this->m_kequal (n->m_key, key))
-      {
-        *val = n->m_val;
-        this->set_matrix_mru (idx);
-        return true;
-      }
-
-      i = (i + 1) & MAX_SIZE_MINUS_1;
-      idx = m_lmap [i];
-    }
+      0x00, 0x01, 0xff, 0x02, 0xff, 0xff, 0xff, 0x03,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x04,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x05,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x06,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07,
+    };
 
-    return false;
+    uint8_t idx = ((y * 0x0002040810204081) >> 56) - 1;
+    uint8_t r = nlzlut [idx];
+    return r;
+#endif
   }
 
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
 
-  void clear ()
+  static uint64_t lowest (uint64_t y)         // isolate the lowest flagged byte
   {
-    this->new_matrix ();
-    memset (m_lmap, IDX_INVALID, sizeof (m_lmap));
+    return y & (0 - y);
   }
 
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
 
-  lru_cache8 () : m_matrix (0)
+  static uint8_t bit_index (uint32_t b)       // 'b' must have exactly one bit set
   {
-    this->clear ();
+#if LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_MSVC
+    unsigned long r;
+    _BitScanForward (&r, b);
+    return static_cast<uint8_t>(r);
+#elif (LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_BUILTIN) && (defined (__aarch64__) || defined (__arm__))
+    return static_cast<uint8_t>(31 - __builtin_clz (b));
+#elif LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_BUILTIN
+    return static_cast<uint8_t>(__builtin_ctz (b));
+#elif LRUCACHE8_BITSCAN == LRUCACHE8_BITSCAN_STD
+    return static_cast<uint8_t>(std::countr_zero (b));
+#else
+    static const uint8_t debruijn [32] =
+    {
+      0,  1, 28,  2, 29, 14, 24,  3, 30, 22, 20, 15, 25, 17,  4,  8,
+      31, 27, 13, 23, 21, 19, 16,  7, 26, 12, 18,  6, 11,  5, 10,  9,
+    };
+
+    return debruijn [(b * 0x077cb531u) >> 27];
+#endif
   }
+};
 
-private:
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
 
-  //////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////
+// The LRU "reference matrix" for 8 ways packed into a single 64-bit word.
+// Shared by lru_cache8 and the containers built on top of it.
 
-  void new_matrix ()
+struct lru8_matrix
+{
+  static uint64_t init ()
   {
     /*
       the low-order 8 bits hold row 0 of the matrix
@@ -291,19 +296,31 @@ private:
       01111111
     */
 
-    m_matrix = 0x7f3f1f0f07030100;
+    return 0x7f3f1f0f07030100;
   }
 
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
 
-  uint8_t get_matrix_lru ()
+  static uint8_t get_lru (uint64_t m)
   {
-    uint64_t m = m_matrix;
-
 #if LRUCACHE8_DEBUG_DISABLE_BRANCH_FREE_LRU
 
+    return get_lru_branchy (m);
+
+#else
+
+    // search for zero byte (branch-free)
+    return lru8_swar::byte_index (lru8_swar::zero_bytes (m));
+
+#endif
+  }
+
+  // the reference search, which every bit-scan backend must agree with
+
+  static uint8_t get_lru_branchy (uint64_t m)
+  {
     // search for zero byte    
     if ((m & 0x00000000000000ff) == 0) return 0;
     if ((m & 0x000000000000ff00) == 0) return 1;
@@ -314,71 +331,2210 @@ private:
     if ((m & 0x00ff000000000000) == 0) return 6;
     if ((m & 0xff00000000000000) == 0) return 7;
     return 0xff;
+  }
 
-#else
-
-    // search for zero byte (branch-free)
-    static const uint64_t c = 0x7f7f7f7f7f7f7f7f;    
-    uint64_t y = (m & c) + c;
-    y = ~(y | m | c);                         // convert 0-bytes to 0x80 and non-0-bytes to 0x00
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
 
-#ifdef LRUCACHE8_USE_INTRINSICS
-    uint64_t n = _lc8_nlz (y);                // number of leading zero bits from the right
-    uint8_t r = static_cast<uint8_t>(n >> 3); // convert bit count to byte count
-    return 7u - r;                            // reverse index position to the left
-#else    
-    static const uint8_t nlzlut [128] =
-    {
-      0x00, 0x01, 0xff, 0x02, 0xff, 0xff, 0xff, 0x03,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x04,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x05,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x06,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07,
-    };
+  static uint64_t set_mru (uint64_t m, uint8_t i)
+  {
+    // set row i (every bit of byte i) to 1s
+    uint64_t rmask = 0xffull << (i << 3); // optimized form of [i * 8]
+    m |= rmask;
 
-    uint8_t idx = ((y * 0x0002040810204081) >> 56) - 1;
-    uint8_t r = nlzlut [idx];
-    return r;
-#endif
+    // set column i (all i-th bits of each byte) to 0s     
+    uint64_t cmask = ~(0x0101010101010101 << i);
+    m &= cmask;
 
-#endif
+    return m;
   }
 
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
 
-  void set_matrix_mru (uint8_t i)
+  static uint64_t set_lru (uint64_t m, uint8_t i)
   {
-    // set row i (every bit of byte i) to 1s
-    uint64_t rmask = 0xffull << (i << 3); // optimized form of [i * MAX_SIZE]
-    m_matrix |= rmask;
+    // the inverse of set_mru: column i to 1s, then row i to 0s (every other way is now
+    // more recent than i, and row i is the only zero row)
+    m |= 0x0101010101010101 << i;
+    m &= ~(0xffull << (i << 3));
+    return m;
+  }
+};
 
-    // set column i (all i-th bits of each byte) to 0s     
-    uint64_t cmask = ~(0x0101010101010101 << i);
-    m_matrix &= cmask;
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Per-associativity storage for the reference matrix and way tags. Each specialization keeps
+// a branch-free get_lru and returns tag matches as a mask, iterated with 'lowest'/'index'
+// (or gathered into one bit per way with 'way_bits'):
+//
+//  4 ways: 16-bit matrix (one nibble per row), 4 tags in a uint32_t        (SWAR)
+//  8 ways: 64-bit matrix (one byte per row),   8 tags in a uint64_t        (SWAR)
+// 16 ways: 256-bit matrix (16-bit rows),       16 tags                     (SSE2/AVX2)
+// 32 ways: 1024-bit matrix (32-bit rows),      32 tags                     (SSE2/AVX2)
+
+template<uint8_t _Ways> struct lru8_ways;
+
+template<> struct lru8_ways<4>
+{
+  typedef uint16_t matrix_t;
+  typedef uint32_t tags_t;
+  typedef uint32_t mask_t;
+  typedef uint8_t  bits_t;
+
+  static void init (matrix_t &m)              { m = 0x7310; }
+  static void set_mru (matrix_t &m, uint8_t i)
+  {
+    m |= static_cast<matrix_t>(0xf << (i << 2));
+    m &= static_cast<matrix_t>(~(0x1111 << i));
+  }
+
+  static void set_lru (matrix_t &m, uint8_t i)
+  {
+    m |= static_cast<matrix_t>(0x1111 << i);
+    m &= static_cast<matrix_t>(~(0xf << (i << 2)));
+  }
+
+  static uint8_t get_lru (matrix_t m)
+  {
+    // search for zero nibble (branch-free), as lru8_swar::zero_bytes does for bytes
+    static const uint32_t c = 0x7777;
+    uint32_t y = ~(((m & c) + c) | m | c) & 0x8888;
+    return lru8_swar::bit_index (y) >> 2;
+  }
+
+  static uint8_t get_lru (matrix_t m, uint32_t rows)
+  {
+    // LRU among 'rows' only: keep their columns, and set the (always 0) diagonal bit
+    // of every other row so it can not be the zero row
+    uint32_t others = ~rows & 0xf;
+    return get_lru (static_cast<matrix_t>((m & (rows * 0x1111)) | ((others * 0x1111) & 0x8421)));
+  }
+
+  static void clear_tags (tags_t &t)          { t = 0; }
+  static uint8_t get_tag (const tags_t &t, uint8_t i) { return static_cast<uint8_t>(t >> (i << 3)); }
+  static void set_tag (tags_t &t, uint8_t i, uint8_t tag)
+  {
+    uint8_t shift = i << 3;
+    t = (t & ~(0xffu << shift)) | (static_cast<uint32_t>(tag) << shift);
+  }
+
+  static mask_t match (const tags_t &t, uint8_t tag)
+  {
+    static const uint32_t c = 0x7f7f7f7f;
+    uint32_t m = t ^ (0x01010101u * tag);
+    return ~(((m & c) + c) | m | c);
+  }
+
+  static mask_t lowest (mask_t y)             { return y & (0 - y); }
+  static uint8_t index (mask_t y)             { return lru8_swar::bit_index (y) >> 3; }
+  static uint32_t way_bits (mask_t y)         { return static_cast<uint32_t>((static_cast<uint64_t>(y) * 0x0002040810204081ull) >> 56); }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<> struct lru8_ways<8>
+{
+  typedef uint64_t matrix_t;
+  typedef uint64_t tags_t;
+  typedef uint64_t mask_t;
+  typedef uint8_t  bits_t;
+
+  static void init (matrix_t &m)              { m = lru8_matrix::init (); }
+  static void set_mru (matrix_t &m, uint8_t i) { m = lru8_matrix::set_mru (m, i); }
+  static void set_lru (matrix_t &m, uint8_t i) { m = lru8_matrix::set_lru (m, i); }
+  static uint8_t get_lru (matrix_t m)         { return lru8_matrix::get_lru (m); }
+  static uint8_t get_lru (matrix_t m, uint32_t rows)
+  {
+    // as lru8_ways<4>: the diagonal of the rows outside the subset is 0x8040201008040201
+    uint64_t others = ~rows & 0xff;
+    return get_lru ((m & lru8_swar::broadcast (static_cast<uint8_t>(rows))) | (lru8_swar::broadcast (static_cast<uint8_t>(others)) & 0x8040201008040201ull));
+  }
+
+  static void clear_tags (tags_t &t)          { t = 0; }
+  static uint8_t get_tag (const tags_t &t, uint8_t i) { return static_cast<uint8_t>(t >> (i << 3)); }
+  static void set_tag (tags_t &t, uint8_t i, uint8_t tag)
+  {
+    uint8_t shift = i << 3;
+    t = (t & ~(0xffull << shift)) | (static_cast<uint64_t>(tag) << shift);
+  }
+
+  static mask_t match (const tags_t &t, uint8_t tag)
+  {
+    return lru8_swar::zero_bytes (t ^ lru8_swar::broadcast (tag));
+  }
+
+  static mask_t lowest (mask_t y)             { return lru8_swar::lowest (y); }
+  static uint8_t index (mask_t y)             { return lru8_swar::byte_index (y); }
+  static uint32_t way_bits (mask_t y)         { return static_cast<uint32_t>((y * 0x0002040810204081ull) >> 56); }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// 16 and 32 ways: one row per 16/32-bit lane. Setting MRU is one broadcast AND over the
+// whole matrix plus a row store; the LRU is the single all-zero row, found with a vector
+// compare + movemask. Without SSE2 the same loops are written out lane by lane.
+
+template<uint8_t _Ways, typename _Row> struct lru8_ways_wide
+{
+  typedef _Row    matrix_t [_Ways];
+  typedef uint8_t tags_t [_Ways];
+  typedef uint32_t mask_t;
+  typedef _Row    bits_t;
+
+  static void init (matrix_t &m)
+  {
+    for (uint8_t r = 0; r < _Ways; ++r)
+    {
+      m [r] = static_cast<_Row>((static_cast<uint64_t>(1) << r) - 1);
+    }
+  }
+
+  static void set_lru (matrix_t &m, uint8_t i)
+  {
+    for (uint8_t r = 0; r < _Ways; ++r) { m [r] |= static_cast<_Row>(1u << i); }
+    m [i] = 0;
+  }
+
+  static void clear_tags (tags_t &t)          { memset (t, 0, sizeof (tags_t)); }
+  static uint8_t get_tag (const tags_t &t, uint8_t i) { return t [i]; }
+  static void set_tag (tags_t &t, uint8_t i, uint8_t tag) { t [i] = tag; }
+
+  static mask_t lowest (mask_t y)             { return y & (0 - y); }
+  static uint8_t index (mask_t y)             { return lru8_swar::bit_index (y); }
+  static uint32_t way_bits (mask_t y)         { return y; }
+
+  static mask_t match (const tags_t &t, uint8_t tag)
+  {
+    mask_t mask = 0;
+#ifdef LRUCACHE8_USE_SSE2
+    __m128i k = _mm_set1_epi8 (static_cast<char>(tag));
+    for (uint8_t i = 0; i < _Ways; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i *>(&t [i]));
+      mask |= static_cast<mask_t>(_mm_movemask_epi8 (_mm_cmpeq_epi8 (v, k))) << i;
+    }
+#else
+    for (uint8_t i = 0; i < _Ways; ++i)
+    {
+      mask |= static_cast<mask_t>(t [i] == tag) << i;
+    }
+#endif
+    return mask;
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<> struct lru8_ways<16> : public lru8_ways_wide<16, uint16_t>
+{
+  static void set_mru (matrix_t &m, uint8_t i)
+  {
+#if defined (LRUCACHE8_USE_AVX2)
+    __m256i *p = reinterpret_cast<__m256i *>(m);
+    _mm256_storeu_si256 (p, _mm256_and_si256 (_mm256_loadu_si256 (p), _mm256_set1_epi16 (static_cast<short>(~(1u << i)))));
+#elif defined (LRUCACHE8_USE_SSE2)
+    __m128i c = _mm_set1_epi16 (static_cast<short>(~(1u << i)));
+    __m128i *p = reinterpret_cast<__m128i *>(m);
+    _mm_storeu_si128 (p + 0, _mm_and_si128 (_mm_loadu_si128 (p + 0), c));
+    _mm_storeu_si128 (p + 1, _mm_and_si128 (_mm_loadu_si128 (p + 1), c));
+#else
+    uint16_t c = static_cast<uint16_t>(~(1u << i));
+    for (uint8_t r = 0; r < 16; ++r) { m [r] &= c; }
+#endif
+    m [i] = static_cast<uint16_t>(~(1u << i));
+  }
+
+  static uint8_t get_lru (const matrix_t &m)
+  {
+#if defined (LRUCACHE8_USE_AVX2)
+    __m256i v = _mm256_loadu_si256 (reinterpret_cast<const __m256i *>(m));
+    uint32_t z = static_cast<uint32_t>(_mm256_movemask_epi8 (_mm256_cmpeq_epi16 (v, _mm256_setzero_si256 ())));
+    return lru8_swar::bit_index (z & (0 - z)) >> 1;  // 2 mask bits per row
+#elif defined (LRUCACHE8_USE_SSE2)
+    const __m128i *p = reinterpret_cast<const __m128i *>(m);
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i lo = _mm_cmpeq_epi16 (_mm_loadu_si128 (p + 0), zero);
+    __m128i hi = _mm_cmpeq_epi16 (_mm_loadu_si128 (p + 1), zero);
+    uint32_t z = static_cast<uint32_t>(_mm_movemask_epi8 (_mm_packs_epi16 (lo, hi)));
+    return lru8_swar::bit_index (z);
+#else
+    uint32_t z = 0;
+    for (uint8_t r = 0; r < 16; ++r) { z |= static_cast<uint32_t>(m [r] == 0) << r; }
+    return lru8_swar::bit_index (z);
+#endif
+  }
+
+  static uint8_t get_lru (const matrix_t &m, uint32_t rows)
+  {
+    matrix_t y;
+    for (uint8_t r = 0; r < 16; ++r)
+    {
+      y [r] = static_cast<uint16_t>((m [r] & rows) | (((~rows >> r) & 1u) << r));
+    }
+    return get_lru (y);
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<> struct lru8_ways<32> : public lru8_ways_wide<32, uint32_t>
+{
+  static void set_mru (matrix_t &m, uint8_t i)
+  {
+#if defined (LRUCACHE8_USE_AVX2)
+    __m256i c = _mm256_set1_epi32 (static_cast<int>(~(1u << i)));
+    __m256i *p = reinterpret_cast<__m256i *>(m);
+    for (uint8_t v = 0; v < 4; ++v) { _mm256_storeu_si256 (p + v, _mm256_and_si256 (_mm256_loadu_si256 (p + v), c)); }
+#elif defined (LRUCACHE8_USE_SSE2)
+    __m128i c = _mm_set1_epi32 (static_cast<int>(~(1u << i)));
+    __m128i *p = reinterpret_cast<__m128i *>(m);
+    for (uint8_t v = 0; v < 8; ++v) { _mm_storeu_si128 (p + v, _mm_and_si128 (_mm_loadu_si128 (p + v), c)); }
+#else
+    uint32_t c = ~(1u << i);
+    for (uint8_t r = 0; r < 32; ++r) { m [r] &= c; }
+#endif
+    m [i] = ~(1u << i);
+  }
+
+  static uint8_t get_lru (const matrix_t &m)
+  {
+    uint32_t z = 0;
+#if defined (LRUCACHE8_USE_AVX2)
+    const __m256i *p = reinterpret_cast<const __m256i *>(m);
+    for (uint8_t v = 0; v < 4; ++v)
+    {
+      __m256i e = _mm256_cmpeq_epi32 (_mm256_loadu_si256 (p + v), _mm256_setzero_si256 ());
+      z |= static_cast<uint32_t>(_mm256_movemask_ps (_mm256_castsi256_ps (e))) << (v << 3);
+    }
+#elif defined (LRUCACHE8_USE_SSE2)
+    const __m128i *p = reinterpret_cast<const __m128i *>(m);
+    for (uint8_t v = 0; v < 8; ++v)
+    {
+      __m128i e = _mm_cmpeq_epi32 (_mm_loadu_si128 (p + v), _mm_setzero_si128 ());
+      z |= static_cast<uint32_t>(_mm_movemask_ps (_mm_castsi128_ps (e))) << (v << 2);
+    }
+#else
+    for (uint8_t r = 0; r < 32; ++r) { z |= static_cast<uint32_t>(m [r] == 0) << r; }
+#endif
+    return lru8_swar::bit_index (z);
+  }
+
+  static uint8_t get_lru (const matrix_t &m, uint32_t rows)
+  {
+    matrix_t y;
+    for (uint8_t r = 0; r < 32; ++r)
+    {
+      y [r] = static_cast<uint32_t>((m [r] & rows) | (((~rows >> r) & 1u) << r));
+    }
+    return get_lru (y);
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Replacement policies, selected by lru_cache8's '_Policy' parameter. Each one keeps its
+// per-set state in 'state_t' and exposes:
+//
+//  init (s)              empty set
+//  on_access (s, i)      hit on way i (read, find, in-place update)
+//  on_insert (s, i)      new entry in way i (the way last returned by 'victim', or an empty or
+//                        expired one)
+//  on_erase (s, i)       way i was emptied: make it the next victim
+//  victim (s)            the way to replace next, asked only when no way is empty or expired
+//                        (without changing s: a write may still be refused by admission)
+//  on_replace (s, i)     the entry in way i, the last way returned by 'victim', is replaced
+//
+//  lru8_replace_lru      true LRU, the reference matrix (8 bytes for 8 ways)
+//  lru8_replace_plru     tree pseudo-LRU, _Ways - 1 bits (1 byte for 8 ways)
+//  lru8_replace_clock    CLOCK / second chance: a reference bit per way and a hand
+//  lru8_replace_slru     segmented LRU: a hit moves a way from probation to a protected
+//                        segment of 3/4 of the ways; only probation ways are replaced
+
+template<uint8_t _Ways> struct lru8_replace_lru
+{
+  typedef lru8_ways<_Ways> ways_t;
+  typedef typename ways_t::matrix_t state_t;
+
+  static void init (state_t &s)                       { ways_t::init (s); }
+  static void on_access (state_t &s, uint8_t i)       { ways_t::set_mru (s, i); }
+  static void on_insert (state_t &s, uint8_t i)       { ways_t::set_mru (s, i); }
+  static void on_erase (state_t &s, uint8_t i)        { ways_t::set_lru (s, i); }
+  static void on_replace (state_t &, uint8_t)         {}
+  static uint8_t victim (const state_t &s)            { return ways_t::get_lru (s); }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<uint8_t _Ways> struct lru8_replace_plru
+{
+  typedef typename lru8_ways<_Ways>::bits_t state_t;
+
+  static const uint8_t LEVELS = (_Ways == 4) ? 2 : (_Ways == 8) ? 3 : (_Ways == 16) ? 4 : 5;
+
+  static void init (state_t &s)                       { s = 0; }
+  static void on_insert (state_t &s, uint8_t i)       { on_access (s, i); }
+
+  static void on_access (state_t &s, uint8_t i)
+  {
+    // nodes of the tree are bits 1 .. _Ways - 1 (node n has children 2n, 2n + 1);
+    // point every node on the path to way i away from it
+    uint32_t t = s;
+    uint32_t n = 1;
+    for (uint8_t l = LEVELS; l > 0; --l)
+    {
+      uint32_t dir = (i >> (l - 1)) & 1u;
+      t = (t & ~(1u << n)) | ((dir ^ 1u) << n);
+      n = (n << 1) | dir;
+    }
+    s = static_cast<state_t>(t);
+  }
+
+  static void on_erase (state_t &s, uint8_t i)
+  {
+    // as on_access, but point the path at way i
+    uint32_t t = s;
+    uint32_t n = 1;
+    for (uint8_t l = LEVELS; l > 0; --l)
+    {
+      uint32_t dir = (i >> (l - 1)) & 1u;
+      t = (t & ~(1u << n)) | (dir << n);
+      n = (n << 1) | dir;
+    }
+    s = static_cast<state_t>(t);
+  }
+
+  static void on_replace (state_t &, uint8_t)         {}
+
+  static uint8_t victim (const state_t &s)
+  {
+    // follow the pointers from the root
+    uint32_t t = s;
+    uint32_t n = 1;
+    for (uint8_t l = 0; l < LEVELS; ++l)
+    {
+      n = (n << 1) | ((t >> n) & 1u);
+    }
+    return static_cast<uint8_t>(n - _Ways);
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<uint8_t _Ways> struct lru8_replace_clock
+{
+  struct state_t
+  {
+    typename lru8_ways<_Ways>::bits_t m_ref;
+    uint8_t                           m_hand;
+  };
+
+  static const uint32_t ALL = static_cast<uint32_t>((static_cast<uint64_t>(1) << _Ways) - 1);
+
+  static void init (state_t &s)                       { s.m_ref = 0; s.m_hand = 0; }
+  static void on_access (state_t &s, uint8_t i)       { s.m_ref |= static_cast<typename lru8_ways<_Ways>::bits_t>(1u << i); }
+
+  static void on_insert (state_t &s, uint8_t i)
+  {
+    // a new entry starts unreferenced, and the hand moves past it
+    s.m_ref &= static_cast<typename lru8_ways<_Ways>::bits_t>(~(1u << i));
+    s.m_hand = static_cast<uint8_t>((i + 1) & (_Ways - 1));
+  }
+
+  static void on_erase (state_t &s, uint8_t i)
+  {
+    // unreferenced, under the hand
+    s.m_ref &= static_cast<typename lru8_ways<_Ways>::bits_t>(~(1u << i));
+    s.m_hand = i;
+  }
+
+  static uint8_t victim (const state_t &s)
+  {
+    // the first unreferenced way from the hand on (branch-free: rotate the hand to bit 0
+    // and isolate the lowest bit), or the hand itself when every way is referenced
+    uint32_t h = s.m_hand;
+    uint32_t z = ~static_cast<uint32_t>(s.m_ref) & ALL;
+    uint32_t r = ((z >> h) | (z << ((_Ways - h) & (_Ways - 1)))) & ALL;
+    return r ? static_cast<uint8_t>((h + lru8_swar::bit_index (r & (0 - r))) & (_Ways - 1)) : static_cast<uint8_t>(h);
+  }
+
+  static void on_replace (state_t &s, uint8_t i)
+  {
+    // the hand sweeps to way i, clearing the reference bits it passes; if way i is itself
+    // referenced, every way was, and a full sweep clears them all
+    uint32_t h = s.m_hand;
+    uint32_t swept = (static_cast<uint32_t>(1) << ((i - h) & (_Ways - 1))) - 1;
+    swept = ((swept << h) | (swept >> ((_Ways - h) & (_Ways - 1)))) & ALL;
+    swept = ((s.m_ref >> i) & 1u) ? ALL : swept;
+    s.m_ref &= static_cast<typename lru8_ways<_Ways>::bits_t>(~swept);
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<uint8_t _Ways> struct lru8_replace_slru
+{
+  typedef lru8_ways<_Ways> ways_t;
+
+  struct state_t
+  {
+    typename ways_t::matrix_t m_matrix;
+    typename ways_t::bits_t   m_protected;
+    uint8_t                   m_count;
+  };
+
+  static const uint8_t PROTECTED_MAX = _Ways - (_Ways >> 2);
+  static const uint32_t ALL = static_cast<uint32_t>((static_cast<uint64_t>(1) << _Ways) - 1);
+
+  static void init (state_t &s)
+  {
+    ways_t::init (s.m_matrix);
+    s.m_protected = 0;
+    s.m_count = 0;
+  }
+
+  static void on_access (state_t &s, uint8_t i)
+  {
+    ways_t::set_mru (s.m_matrix, i);
+
+    uint32_t bit = 1u << i;
+    if (!(s.m_protected & bit))
+    {
+      if (s.m_count == PROTECTED_MAX)
+      {
+        // full: the least recent protected way goes back to probation (keeping its recency)
+        uint8_t j = ways_t::get_lru (s.m_matrix, s.m_protected);
+        s.m_protected &= static_cast<typename ways_t::bits_t>(~(1u << j));
+        --s.m_count;
+      }
+
+      s.m_protected |= static_cast<typename ways_t::bits_t>(bit);
+      ++s.m_count;
+    }
+  }
+
+  static void on_insert (state_t &s, uint8_t i)
+  {
+    // a new entry starts in probation ('victim' only returns probation ways, but an
+    // expired way may have been protected)
+    ways_t::set_mru (s.m_matrix, i);
+
+    uint32_t bit = 1u << i;
+    if (s.m_protected & bit)
+    {
+      s.m_protected &= static_cast<typename ways_t::bits_t>(~bit);
+      --s.m_count;
+    }
+  }
+
+  static void on_erase (state_t &s, uint8_t i)
+  {
+    on_insert (s, i);
+    ways_t::set_lru (s.m_matrix, i);
+  }
+
+  static void on_replace (state_t &, uint8_t)         {}
+
+  static uint8_t victim (const state_t &s)
+  {
+    return ways_t::get_lru (s.m_matrix, ~static_cast<uint32_t>(s.m_protected) & ALL);
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Statistics policies, selected by lru_cache8's '_Stats' parameter.
+//
+// lru8_stats_none (the default) has empty inline hooks that compile away, and as an empty
+// member takes no storage in the set (see LRUCACHE8_NO_UNIQUE_ADDRESS).
+// lru8_stats_counters counts lookups, writes, evictions, rejects and erases, plus a histogram
+// of how many full key compares each probe needed (more than 1 means tag collisions, i.e. poor
+// hashing).
+// Snapshots are plain lru8_stats values that merge, to aggregate over many caches.
+
+struct lru8_stats
+{
+  static const uint8_t PROBE_BUCKETS = 4;     // 0, 1, 2, 3+ key compares
+
+  uint64_t m_hits;
+  uint64_t m_misses;
+  uint64_t m_inserts;
+  uint64_t m_updates;
+  uint64_t m_evictions;
+  uint64_t m_rejects;                         // inserts refused by an admission policy
+  uint64_t m_erases;
+  uint64_t m_probes [PROBE_BUCKETS];
+
+  void merge (const lru8_stats &s)
+  {
+    m_hits += s.m_hits;
+    m_misses += s.m_misses;
+    m_inserts += s.m_inserts;
+    m_updates += s.m_updates;
+    m_evictions += s.m_evictions;
+    m_rejects += s.m_rejects;
+    m_erases += s.m_erases;
+    for (uint8_t i = 0; i < PROBE_BUCKETS; ++i) { m_probes [i] += s.m_probes [i]; }
+  }
+
+  double hit_ratio () const
+  {
+    uint64_t n = m_hits + m_misses;
+    return n ? (static_cast<double>(m_hits) / n) : 0.0;
+  }
+
+  lru8_stats () { memset (this, 0, sizeof (*this)); }
+};
+
+struct lru8_stats_none
+{
+  void on_hit () {}
+  void on_miss () {}
+  void on_insert () {}
+  void on_update () {}
+  void on_evict () {}
+  void on_reject () {}
+  void on_erase () {}
+  void on_probe (uint8_t) {}
+  void reset () {}
+  lru8_stats snapshot () const { return lru8_stats (); }
+};
+
+struct lru8_stats_counters
+{
+  void on_hit ()                { ++m_stats.m_hits; }
+  void on_miss ()               { ++m_stats.m_misses; }
+  void on_insert ()             { ++m_stats.m_inserts; }
+  void on_update ()             { ++m_stats.m_updates; }
+  void on_evict ()              { ++m_stats.m_evictions; }
+  void on_reject ()             { ++m_stats.m_rejects; }
+  void on_erase ()              { ++m_stats.m_erases; }
+  void on_probe (uint8_t n)     { ++m_stats.m_probes [(n < lru8_stats::PROBE_BUCKETS) ? n : (lru8_stats::PROBE_BUCKETS - 1)]; }
+  void reset ()                 { m_stats = lru8_stats (); }
+  lru8_stats snapshot () const  { return m_stats; }
+
+  lru8_stats m_stats;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Admission policies, for lru_cache8::write_admit and lru_cache_sa's '_Admit' parameter.
+// Both are constructed with the capacity of the cache they guard and expose:
+//
+//  record (h)            an access (hit or miss) to the key with hash h
+//  admit (h, victim)     true if a new key with hash h may replace the entry with hash 'victim'
+//
+// lru8_admit_all (the default) admits everything and compiles away.
+// lru8_tinylfu is a TinyLFU filter: a count-min sketch of 4-bit counters (4 rows, 16 counters
+// per word, a key's 4 counters in one cache line) estimates how often each hash was seen
+// recently, and a miss only replaces a victim that is less popular than itself. Once
+// 10 * capacity increments have been recorded, every counter is halved, so the estimates
+// follow a changing working set.
+
+struct lru8_admit_all
+{
+  void record (uint32_t) {}
+  bool admit (uint32_t, uint32_t) const { return true; }
+  void clear () {}
+
+  lru8_admit_all () {}
+  explicit lru8_admit_all (uint32_t) {}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class lru8_tinylfu
+{
+public:
+
+  void record (uint32_t h)
+  {
+    uint64_t *block = this->block (h);
+    uint64_t x = mix (h);
+    uint64_t added = 0;
+    for (uint8_t r = 0; r < ROWS; ++r)
+    {
+      // saturating increment, branch-free: the counters of new and hot keys alike are
+      // too unpredictable for a branch on 15
+      uint64_t &w = block [word (x, r)];
+      uint32_t shift = nibble (x, r);
+      uint64_t inc = 1 - ((((w >> shift) & 0xf) + 1) >> 4);
+      w += inc << shift;
+      added |= inc;
+    }
+
+    if (added && (++m_additions == m_sample))
+    {
+      this->age ();
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  uint8_t estimate (uint32_t h) const
+  {
+    const uint64_t *block = this->block (h);
+    uint64_t x = mix (h);
+    uint64_t f = 0xf;
+    for (uint8_t r = 0; r < ROWS; ++r)
+    {
+      uint64_t c = (block [word (x, r)] >> nibble (x, r)) & 0xf;
+      f = (c < f) ? c : f;
+    }
+    return static_cast<uint8_t>(f);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool admit (uint32_t h, uint32_t victim) const
+  {
+    return this->estimate (h) > this->estimate (victim);
+  }
+
+  void clear ()
+  {
+    memset (m_table, 0, (m_mask + 1) * BLOCK_WORDS * sizeof (uint64_t));
+    m_additions = 0;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  explicit lru8_tinylfu (uint32_t capacity) : m_additions (0), m_sample (capacity * 10)
+  {
+    // about 8 counters per cached entry, in a power-of-2 number of cache-line sized blocks
+    uint32_t blocks = 1;
+    while ((blocks * BLOCK_WORDS * 2) < capacity)
+    {
+      blocks <<= 1;
+    }
+
+    m_mask = blocks - 1;
+    m_table = new uint64_t [blocks * BLOCK_WORDS];
+    this->clear ();
+  }
+
+  ~lru8_tinylfu ()
+  {
+    delete [] m_table;
+  }
+
+private:
+
+  static const uint8_t ROWS = 4;
+  static const uint8_t BLOCK_WORDS = 8;       // 64 bytes: a key's counters share one cache line
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // the high half of the product picks the block; the low half, folded with the high half,
+  // picks a word from each pair of the block (row r uses words 2r, 2r + 1) and a counter in it
+
+  static uint64_t mix (uint32_t h)
+  {
+    uint64_t x = h * 0x9e3779b97f4a7c15ull;
+    return x ^ (x >> 32);
+  }
+
+  static uint32_t word (uint64_t x, uint8_t r)    { return (r << 1) | static_cast<uint32_t>((x >> r) & 1); }
+  static uint32_t nibble (uint64_t x, uint8_t r)  { return static_cast<uint32_t>((x >> (8 + (r << 2))) & 0xf) << 2; }
+
+  uint64_t *block (uint32_t h) const
+  {
+    uint32_t b = static_cast<uint32_t>((h * 0x9e3779b97f4a7c15ull) >> 32) & m_mask;
+    return &m_table [b * BLOCK_WORDS];
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void age ()
+  {
+    // halve every counter at once (the shifted-in bit of each nibble is masked away)
+    for (uint32_t i = 0; i < (m_mask + 1) * BLOCK_WORDS; ++i)
+    {
+      m_table [i] = (m_table [i] >> 1) & 0x7777777777777777ull;
+    }
+
+    m_additions >>= 1;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru8_tinylfu (const lru8_tinylfu &);
+  lru8_tinylfu &operator= (const lru8_tinylfu &);
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  uint64_t   *m_table;
+  uint32_t    m_mask;
+  uint32_t    m_additions;
+  uint32_t    m_sample;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Expiry policies, selected by lru_cache8's '_Expiry' parameter.
+//
+// lru8_expiry_none (the default) stores nothing and never expires an entry.
+// lru8_expiry<_Clock> adds a 32-bit deadline to every entry, in ticks of '_Clock' (any type with
+// a static 'uint32_t now ()'). Expiry is lazy: an expired entry is a miss for read, find, peek
+// and get_or_load, a write of its key rewrites it in place, and a new key replaces it before
+// the replacement policy's victim.
+
+struct lru8_expiry_none
+{
+  template<uint8_t _Ways> struct stamps_t
+  {
+    void set_deadline (uint8_t, uint32_t) {}
+    bool expired (uint8_t, uint32_t) const { return false; }
+  };
+
+  static const bool ENABLED = false;
+
+  uint32_t now () const                       { return 0; }
+  uint32_t ttl () const                       { return 0; }
+  void set_ttl (uint32_t)                     {}
+  static uint32_t deadline (uint32_t, uint32_t) { return 0; }
+};
+
+template<typename _Clock> struct lru8_expiry
+{
+  template<uint8_t _Ways> struct stamps_t
+  {
+    uint32_t m_deadline [_Ways];              // tick each entry expires at, 0 == never
+
+    void set_deadline (uint8_t i, uint32_t d) { m_deadline [i] = d; }
+    bool expired (uint8_t i, uint32_t now) const
+    {
+      return (m_deadline [i] != 0) && (static_cast<int32_t>(now - m_deadline [i]) >= 0);
+    }
+
+    stamps_t () { memset (m_deadline, 0, sizeof (m_deadline)); }
+  };
+
+  static const bool ENABLED = true;
+
+  uint32_t now () const                       { return _Clock::now (); }
+  uint32_t ttl () const                       { return m_ttl; }
+  void set_ttl (uint32_t ticks)               { m_ttl = ticks; }
+
+  static uint32_t deadline (uint32_t now, uint32_t ttl)
+  {
+    // a ttl of 0 never expires; a deadline that wraps to 0 moves one tick later
+    uint32_t d = now + ttl;
+    return ttl ? (d + (d == 0)) : 0;
+  }
+
+  lru8_expiry () : m_ttl (0) {}
+
+  uint32_t m_ttl;                             // for writes that do not give their own
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Coarse clocks for lru8_expiry: wall-clock seconds, or a tick count that the application
+// advances itself (once per frame, from a timer thread, ...) and that costs one load to read.
+
+struct lru8_clock_seconds
+{
+  static uint32_t now ()                      { return static_cast<uint32_t>(time (NULL)); }
+};
+
+struct lru8_clock_ticks
+{
+#if LRUCACHE8_CPP11
+  static uint32_t now ()                      { return counter ().load (std::memory_order_relaxed); }
+  static void advance (uint32_t n = 1)        { counter ().fetch_add (n, std::memory_order_relaxed); }
+
+private:
+
+  static std::atomic<uint32_t> &counter ()    { static std::atomic<uint32_t> t (0); return t; }
+#else
+  static uint32_t now ()                      { return counter (); }
+  static void advance (uint32_t n = 1)        { counter () += n; }
+
+private:
+
+  static volatile uint32_t &counter ()        { static volatile uint32_t t = 0; return t; }
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Eviction policies, selected by lru_cache8's '_Evict' parameter.
+//
+// lru8_evict_none (the default) drops the entry a new key replaces and stores nothing.
+// lru8_evict_to<_Handler> hands that entry (or an expired one that get_or_load reloads in
+// place) to its '_Handler' base before the way is reused, as
+// 'handler (key, value, dirty)' - moved out under C++11, as lvalues it may take from otherwise -
+// and keeps a dirty flag per way. write, write_ttl, write_admit and emplace set the flag,
+// get_or_load fills clean, and flush (sink) passes every dirty entry to 'sink (key, value)' and
+// cleans it. For write-back caching: repeated writes to a hot key reach the backing store once,
+// when the key is evicted or flushed. erase and clear drop entries without calling the handler.
+
+struct lru8_evict_none
+{
+  template<uint8_t _Ways> struct flags_t
+  {
+    void set_dirty (uint8_t, bool) {}
+    bool dirty (uint8_t) const { return false; }
+    bool any () const { return false; }
+    void clear () {}
+  };
+
+  static const bool ENABLED = false;
+
+  template<typename _Key, typename _Val> void evict (_Key &, _Val &, bool) {}
+};
+
+template<typename _Handler> struct lru8_evict_to : public _Handler
+{
+  template<uint8_t _Ways> struct flags_t
+  {
+    uint32_t m_dirty;                         // bit per way
+
+    void set_dirty (uint8_t i, bool d)        { m_dirty = (m_dirty & ~(1u << i)) | (static_cast<uint32_t>(d) << i); }
+    bool dirty (uint8_t i) const              { return ((m_dirty >> i) & 1) != 0; }
+    bool any () const                         { return m_dirty != 0; }
+    void clear ()                             { m_dirty = 0; }
+
+    flags_t () : m_dirty (0) {}
+  };
+
+  static const bool ENABLED = true;
+
+  template<typename _Key, typename _Val> void evict (_Key &key, _Val &val, bool dirty)
+  {
+#if LRUCACHE8_CPP11
+    (*this) (std::move (key), std::move (val), dirty);
+#else
+    (*this) (key, val, dirty);
+#endif
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Key storage for lru_cache8.
+//
+// The general form keeps each entry's full 32-bit hash in the hot part of the set and checks
+// it before calling '_KeyEqual', so a tag collision rarely costs a key compare. Integer, enum
+// and pointer keys of at most 8 bytes that are compared with == (std::equal_to, LRU8EqualTo)
+// are stored without a hash: the keys themselves take the hashes' place, and a probe compares
+// all of them with the probed key at once.
+
+template<typename _Key> struct lru8_small_key
+{
+#if LRUCACHE8_CPP11
+  static const bool value = (std::is_integral<_Key>::value || std::is_enum<_Key>::value || std::is_pointer<_Key>::value) && (sizeof (_Key) <= 8);
+#else
+  static const bool value = false;
+#endif
+};
+
+#if !LRUCACHE8_CPP11
+struct lru8_small_key_yes { static const bool value = true; };
+
+template<> struct lru8_small_key<bool> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<char> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<signed char> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<unsigned char> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<short> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<unsigned short> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<int> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<unsigned int> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<long> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<unsigned long> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<long long> : public lru8_small_key_yes {};
+template<> struct lru8_small_key<unsigned long long> : public lru8_small_key_yes {};
+template<typename _Key> struct lru8_small_key<_Key *> : public lru8_small_key_yes {};
+#endif
+
+// true if '_KeyEqual' is plain == on a small key (specialised for each such functor)
+
+template<typename _Key, typename _KeyEqual> struct lru8_packed_key
+{
+  static const bool value = false;
+};
+
+template<typename _Key> struct lru8_packed_key<_Key, std::equal_to<_Key> > : public lru8_small_key<_Key> {};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// mask of the ways (bit i == way i) whose key is equal to 'key': lane by lane in general,
+// with SSE2/AVX2 compares over the whole key array for 4 and 8 byte keys
+
+template<size_t _Size> struct lru8_key_lanes
+{
+  template<uint8_t _Ways, typename _Key> static uint32_t equal (const _Key (&k) [_Ways], _Key key)
+  {
+    uint32_t mask = 0;
+    for (uint8_t i = 0; i < _Ways; ++i)
+    {
+      mask |= static_cast<uint32_t>(k [i] == key) << i;
+    }
+    return mask;
+  }
+};
+
+#ifdef LRUCACHE8_USE_SSE2
+
+template<> struct lru8_key_lanes<4>
+{
+  template<uint8_t _Ways, typename _Key> static uint32_t equal (const _Key (&k) [_Ways], _Key key)
+  {
+    int32_t x;
+    memcpy (&x, &key, 4);
+
+    uint32_t mask = 0;
+    uint8_t i = 0;
+#if defined (LRUCACHE8_USE_AVX2)
+    __m256i w = _mm256_set1_epi32 (x);
+    for (; (i + 8) <= _Ways; i += 8)
+    {
+      __m256i e = _mm256_cmpeq_epi32 (_mm256_loadu_si256 (reinterpret_cast<const __m256i *>(&k [i])), w);
+      mask |= static_cast<uint32_t>(_mm256_movemask_ps (_mm256_castsi256_ps (e))) << i;
+    }
+#endif
+    __m128i v = _mm_set1_epi32 (x);
+    for (; i < _Ways; i += 4)
+    {
+      __m128i e = _mm_cmpeq_epi32 (_mm_loadu_si128 (reinterpret_cast<const __m128i *>(&k [i])), v);
+      mask |= static_cast<uint32_t>(_mm_movemask_ps (_mm_castsi128_ps (e))) << i;
+    }
+    return mask;
+  }
+};
+
+template<> struct lru8_key_lanes<8>
+{
+  template<uint8_t _Ways, typename _Key> static uint32_t equal (const _Key (&k) [_Ways], _Key key)
+  {
+    __m128i v = _mm_loadl_epi64 (reinterpret_cast<const __m128i *>(&key));
+    v = _mm_unpacklo_epi64 (v, v);
+
+    uint32_t mask = 0;
+#if defined (LRUCACHE8_USE_AVX2)
+    __m256i w = _mm256_broadcastq_epi64 (v);
+    for (uint8_t i = 0; i < _Ways; i += 4)
+    {
+      __m256i e = _mm256_cmpeq_epi64 (_mm256_loadu_si256 (reinterpret_cast<const __m256i *>(&k [i])), w);
+      mask |= static_cast<uint32_t>(_mm256_movemask_pd (_mm256_castsi256_pd (e))) << i;
+    }
+#else
+    for (uint8_t i = 0; i < _Ways; i += 2)
+    {
+      // no 64-bit compare in SSE2: both 32-bit halves must match
+      __m128i e = _mm_cmpeq_epi32 (_mm_loadu_si128 (reinterpret_cast<const __m128i *>(&k [i])), v);
+      e = _mm_and_si128 (e, _mm_shuffle_epi32 (e, _MM_SHUFFLE (2, 3, 0, 1)));
+      mask |= static_cast<uint32_t>(_mm_movemask_pd (_mm_castsi128_pd (e))) << i;
+    }
+#endif
+    return mask;
+  }
+};
+
+#endif
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+template<typename _Key, uint8_t _Ways, bool _Packed> struct lru8_keys
+{
+  typedef lru8_ways<_Ways> ways_t;
+
+  uint32_t  m_hash [_Ways];
+  _Key      m_key [_Ways];
+
+  void set_hash (uint8_t i, uint32_t h)       { m_hash [i] = h; }
+  template<typename _KeyHash> uint32_t hash (uint8_t i, const _KeyHash &) const { return m_hash [i]; }
+
+  // the way among the tag matches 'match' that holds 'key' (0xff if none)
+
+  template<typename _KeyEqual, typename _Stats> uint8_t find (typename ways_t::mask_t match, const _Key &key, uint32_t h, const _KeyEqual &kequal, _Stats &stats) const
+  {
+    uint8_t compares = 0;
+    while (match)
+    {
+      uint8_t idx = ways_t::index (ways_t::lowest (match));
+      ++compares;
+      if ((m_hash [idx] == h) && kequal (m_key [idx], key))
+      {
+        stats.on_probe (compares);
+        return idx;
+      }
+
+      match &= match - 1;
+    }
+
+    stats.on_probe (compares);
+    return 0xff;
+  }
+};
+
+template<typename _Key, uint8_t _Ways> struct lru8_keys<_Key, _Ways, true>
+{
+  typedef lru8_ways<_Ways> ways_t;
+
+  _Key      m_key [_Ways];
+
+  void set_hash (uint8_t, uint32_t)           {}
+  template<typename _KeyHash> uint32_t hash (uint8_t i, const _KeyHash &khash) const { return (uint32_t) khash (m_key [i]); }
+
+  template<typename _KeyEqual, typename _Stats> uint8_t find (typename ways_t::mask_t match, const _Key &key, uint32_t, const _KeyEqual &, _Stats &stats) const
+  {
+    // one compare over all keys; the tag matches only rule out empty ways and stale keys
+    uint32_t hit = ways_t::way_bits (match) & lru8_key_lanes<sizeof (_Key)>::equal (m_key, key);
+    stats.on_probe (match ? 1 : 0);
+    return hit ? lru8_swar::bit_index (hit) : 0xff;     // a key is in one way at most
+  }
+
+  lru8_keys () { memset (m_key, 0, sizeof (m_key)); }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline uint32_t LC8Hash_DJBX33X (const unsigned char *src, size_t sz)
+{
+  uint32_t hash = 5381;
+  for (size_t i = 0; i < sz; ++i) { hash = ((hash << 5) + hash) ^ src [i]; }
+  return hash;
+}
+
+// The default hashers. Numbers and pointers go through a multiply-xorshift mixer, so keys that
+// differ only in their high bits (aligned ids, pointers) still get distinct tags in the low bits
+// and spread over lru_cache_sa's sets. Strings and raw bytes are hashed 8 bytes at a time.
+
+struct lru8_hasher
+{
+  static uint32_t mix (uint64_t x)
+  {
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93ull;
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93ull;
+    x ^= x >> 32;
+    return static_cast<uint32_t>(x);
+  }
+
+  static uint32_t bytes (const void *src, size_t sz)
+  {
+    const unsigned char *p = static_cast<const unsigned char *>(src);
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ sz;
+
+    for (; sz >= 8; p += 8, sz -= 8)
+    {
+      uint64_t w;
+      memcpy (&w, p, 8);
+      h = step (h, w);
+    }
+
+    // 1 to 7 bytes left: two overlapping 4-byte loads, or first/middle/last byte
+    if (sz >= 4)
+    {
+      uint32_t lo, hi;
+      memcpy (&lo, p, 4);
+      memcpy (&hi, p + sz - 4, 4);
+      h = step (h, (static_cast<uint64_t>(hi) << 32) | lo);
+    }
+    else if (sz)
+    {
+      h = step (h, (static_cast<uint64_t>(p [0]) << 16) | (static_cast<uint64_t>(p [sz >> 1]) << 8) | p [sz - 1]);
+    }
+
+    return mix (h);
+  }
+
+private:
+
+  static uint64_t step (uint64_t h, uint64_t w)
+  {
+    h ^= w * 0xbf58476d1ce4e5b9ull;
+    return ((h << 27) | (h >> 37)) * 0x94d049bb133111ebull;
+  }
+};
+
+template<typename _Key> struct LRU8HashBitwise
+{
+  uint32_t operator() (const _Key &k) const
+  {
+    return lru8_hasher::bytes (&k, sizeof (_Key));
+  }
+};
+
+template<typename _Key> struct LRU8HashNumeric
+{
+  uint32_t operator() (_Key k) const
+  {
+    return lru8_hasher::mix (static_cast<uint64_t>(k));
+  }
+};
+
+#if LRUCACHE8_CPP11
+// enums are numbers; anything else that std::hash knows is hashed by it and then mixed, as
+// std::hash may be the identity
+template<typename _Key, bool _Enum = std::is_enum<_Key>::value> struct LRU8HashDefault : public LRU8HashNumeric<_Key> {};
+template<typename _Key> struct LRU8HashDefault<_Key, false>
+{
+  uint32_t operator() (const _Key &k) const
+  {
+    return lru8_hasher::mix (static_cast<uint64_t>(std::hash<_Key> () (k)));
+  }
+};
+
+template<typename _Key> struct LRU8Hash : public LRU8HashDefault<_Key> {};
+#else
+template<typename _Key> struct LRU8Hash
+{
+};
+#endif
+
+template<> struct LRU8Hash<bool> : public LRU8HashNumeric<bool> {};
+template<> struct LRU8Hash<char> : public LRU8HashNumeric<char> {};
+template<> struct LRU8Hash<signed char> : public LRU8HashNumeric<signed char> {};
+template<> struct LRU8Hash<unsigned char> : public LRU8HashNumeric<unsigned char> {};
+template<> struct LRU8Hash<short> : public LRU8HashNumeric<short> {};
+template<> struct LRU8Hash<unsigned short> : public LRU8HashNumeric<unsigned short> {};
+template<> struct LRU8Hash<int> : public LRU8HashNumeric<int> {};
+template<> struct LRU8Hash<unsigned int> : public LRU8HashNumeric<unsigned int> {};
+template<> struct LRU8Hash<long> : public LRU8HashNumeric<long> {};
+template<> struct LRU8Hash<unsigned long> : public LRU8HashNumeric<unsigned long> {};
+template<> struct LRU8Hash<long long> : public LRU8HashNumeric<long long> {};
+template<> struct LRU8Hash<unsigned long long> : public LRU8HashNumeric<unsigned long long> {};
+template<> struct LRU8Hash<std::string>
+{
+  uint32_t operator() (const std::string &k) const
+  {
+    return lru8_hasher::bytes (k.data (), k.size ());
+  }
+};
+
+template<typename _Key> struct LRU8Hash<_Key *>
+{
+  uint32_t operator() (_Key *k) const 
+  { 
+    return lru8_hasher::mix (static_cast<uint64_t>(reinterpret_cast<size_t>(k))); 
+  }
+};
+
+template<typename _Key> struct LRU8EqualTo
+{
+  bool operator() (const _Key &k1, const _Key &k2) const 
+  { 
+    return (k1 == k2); 
+  }
+};
+
+template<typename _Key> struct lru8_packed_key<_Key, LRU8EqualTo<_Key> > : public lru8_small_key<_Key> {};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Fixed-capacity string stored inline, for keys (and values) that never touch the heap.
+//
+// lru8_fixed_string<_Capacity> keeps up to _Capacity (at most 254) bytes and their length in
+// the object itself, zero-padded, so it is trivially copyable, a write copies it without
+// allocating, and equality is one fixed-size compare of bytes already in the set. It converts
+// implicitly from const char *, std::string and (C++17) std::string_view, so a lookup can take
+// any of those without building a std::string. It hashes like std::string.
+//
+// A longer string is kept as 'too long' and equals nothing, itself included: such a key is
+// never found, so the cache misses rather than confusing two keys that share a prefix. The
+// caches refuse to store a too long key or value (see lru8_too_long): write drops it,
+// emplace returns false, and get_or_load returns the loaded value without caching it. Use
+// fits (n) where keys may be long.
+
+template<uint8_t _Capacity> class lru8_fixed_string
+{
+#if LRUCACHE8_CPP11
+  static_assert (_Capacity < 0xff, "lru8_fixed_string holds at most 254 bytes");
+#endif
+
+  static const uint8_t TOO_LONG = 0xff;
+
+public:
+
+  static const uint8_t CAPACITY = _Capacity;
+
+  static bool fits (size_t n)
+  {
+    return n <= _Capacity;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  const char *data () const                   { return m_data; }
+  size_t size () const                        { return (m_size != TOO_LONG) ? m_size : 0; }
+  bool too_long () const                      { return m_size == TOO_LONG; }
+  std::string str () const                    { return std::string (m_data, this->size ()); }
+#if LRUCACHE8_CPP17
+  std::string_view view () const             { return std::string_view (m_data, this->size ()); }
+#endif
+
+  bool operator== (const lru8_fixed_string &other) const
+  {
+    // the padding is zero, so the whole objects (bytes and length) compare in one
+    // fixed-size memcmp, which compilers expand into a few word compares
+    return (m_size != TOO_LONG) && (memcmp (this, &other, sizeof (lru8_fixed_string)) == 0);
+  }
+
+  bool operator!= (const lru8_fixed_string &other) const
+  {
+    return !(*this == other);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru8_fixed_string () : m_size (0)
+  {
+    memset (m_data, 0, _Capacity);
+  }
+
+  lru8_fixed_string (const char *s)           { this->assign (s, strlen (s)); }
+  lru8_fixed_string (const char *s, size_t n) { this->assign (s, n); }
+  lru8_fixed_string (const std::string &s)    { this->assign (s.data (), s.size ()); }
+#if LRUCACHE8_CPP17
+  lru8_fixed_string (std::string_view s)      { this->assign (s.data (), s.size ()); }
+#endif
+
+private:
+
+  void assign (const char *s, size_t n)
+  {
+    memset (m_data, 0, _Capacity);
+    if (n <= _Capacity)
+    {
+      memcpy (m_data, s, n);
+      m_size = static_cast<uint8_t>(n);
+    }
+    else
+    {
+      m_size = TOO_LONG;
+    }
+  }
+
+  char      m_data [_Capacity];
+  uint8_t   m_size;
+};
+
+template<uint8_t _Capacity> struct LRU8Hash<lru8_fixed_string<_Capacity> >
+{
+  uint32_t operator() (const lru8_fixed_string<_Capacity> &k) const
+  {
+    return lru8_hasher::bytes (k.data (), k.size ());
+  }
+};
+
+#if LRUCACHE8_CPP11
+namespace std
+{
+  template<uint8_t _Capacity> struct hash<lru8_fixed_string<_Capacity> >
+  {
+    size_t operator() (const lru8_fixed_string<_Capacity> &k) const
+    {
+      return lru8_hasher::bytes (k.data (), k.size ());
+    }
+  };
+}
+#endif
+
+// can 'x' not be stored as it is? Only an lru8_fixed_string given more than its capacity
+
+template<typename _T> inline bool lru8_too_long (const _T &)
+{
+  return false;
+}
+
+template<uint8_t _Capacity> inline bool lru8_too_long (const lru8_fixed_string<_Capacity> &x)
+{
+  return x.too_long ();
+}
+
+// may a _T be too long? emplace then builds it before it claims a way, to check it first
+
+template<typename _T> struct lru8_length_checked
+{
+  static const bool ENABLED = false;
+};
+
+template<uint8_t _Capacity> struct lru8_length_checked<lru8_fixed_string<_Capacity> >
+{
+  static const bool ENABLED = true;
+};
+
+// where get_or_load keeps a value it loaded but refused to cache, to return a reference to
+// it all the same: one per thread and value type, overwritten by the next refused load
+
+template<typename _Val> _Val &lru8_refused_slot ()
+{
+#if LRUCACHE8_CPP11
+  static thread_local _Val s_val;
+#else
+  static _Val s_val;
+#endif
+  return s_val;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS
+
+template<typename _Key, typename _Val, typename _KeyHash = std::hash<_Key>, typename _KeyEqual = std::equal_to<_Key>, uint8_t _Ways = 8, typename _Stats = lru8_stats_none,
+  template<uint8_t> class _Policy = lru8_replace_lru, typename _Expiry = lru8_expiry_none, typename _Evict = lru8_evict_none>
+
+#else
+
+template<typename _Key, typename _Val, typename _KeyHash = LRU8Hash<_Key>, typename _KeyEqual = LRU8EqualTo<_Key>, uint8_t _Ways = 8, typename _Stats = lru8_stats_none,
+  template<uint8_t> class _Policy = lru8_replace_lru, typename _Expiry = lru8_expiry_none, typename _Evict = lru8_evict_none>
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+class LRUCACHE8_ALIGN_LINE lru_cache8
+{
+public:
+
+  typedef _Key      key_type;
+  typedef _Val      mapped_type;
+  typedef _KeyHash  hasher;
+
+  static const uint8_t MAX_SIZE = _Ways;
+
+private:
+
+  typedef lru8_ways<_Ways> ways_t;
+  typedef _Policy<_Ways> policy_t;
+  typedef lru8_keys<_Key, _Ways, lru8_packed_key<_Key, _KeyEqual>::value> keys_t;
+
+  static const uint8_t IDX_INVALID = 0xff;
+
+public:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (const _Key &key, const _Val &val)
+  {
+    this->write (key, val, (uint32_t) this->m_khash (key));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val)
+  {
+    return this->read (key, val, (uint32_t) this->m_khash (key));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // zero-copy lookups: 'find' promotes like 'read', 'peek' leaves the LRU order alone.
+  // The pointer is valid until the next write to this cache.
+
+  _Val *find (const _Key &key)
+  {
+    return this->find (key, (uint32_t) this->m_khash (key));
+  }
+
+  const _Val *peek (const _Key &key) const
+  {
+    return this->peek (key, (uint32_t) this->m_khash (key));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // remove 'key' (returns false if it was not cached); its way becomes the next victim
+
+  bool erase (const _Key &key)
+  {
+    return this->erase (key, (uint32_t) this->m_khash (key));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // read-through: on a miss 'loader (key)' supplies the value, which is stored in
+  // the way the failed lookup already picked (one hash, one probe). A key or value too
+  // long to store is not cached (see lru8_refused_slot)
+
+  template<typename _Loader> _Val &get_or_load (const _Key &key, _Loader loader)
+  {
+    return this->get_or_load (key, loader, (uint32_t) this->m_khash (key));
+  }
+
+#if LRUCACHE8_CPP11
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (_Key &&key, _Val &&val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    this->write (std::move (key), std::move (val), h);
+  }
+
+  void write (const _Key &key, _Val &&val)
+  {
+    this->write (key, std::move (val), (uint32_t) this->m_khash (key));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // construct the value from 'args' directly in its way (inserting or replacing 'key');
+  // false if the key or value is too long to store (see lru8_fixed_string)
+
+  template<typename... _Args> bool emplace (const _Key &key, _Args&&... args)
+  {
+    return this->emplace_hashed ((uint32_t) this->m_khash (key), key, std::forward<_Args>(args)...);
+  }
+
+#endif
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // pre-hashed variants: 'h' must be the same function of 'key' on every call
+  // (used by containers that hash once to pick an lru_cache8 and again to probe it)
+
+  void write (const _Key &key, const _Val &val, uint32_t h)
+  {
+    this->write_admit (key, val, h, lru8_admit_all (), m_expiry.ttl ());
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // write with its own time to live, in ticks of the '_Expiry' clock (0 == never expires)
+
+  void write_ttl (const _Key &key, const _Val &val, uint32_t ttl)
+  {
+    this->write_ttl (key, val, ttl, (uint32_t) this->m_khash (key));
+  }
+
+  void write_ttl (const _Key &key, const _Val &val, uint32_t ttl, uint32_t h)
+  {
+    this->write_admit (key, val, h, lru8_admit_all (), ttl);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // as write, but a new key only replaces an occupied victim way if 'admit' agrees
+  // (see lru8_tinylfu); returns false if the write was rejected. Recording accesses
+  // in 'admit' is up to the caller.
+
+  template<typename _Admit> bool write_admit (const _Key &key, const _Val &val, uint32_t h, const _Admit &admit)
+  {
+    return this->write_admit (key, val, h, admit, m_expiry.ttl ());
+  }
+
+  template<typename _Admit> bool write_admit (const _Key &key, const _Val &val, uint32_t h, const _Admit &admit, uint32_t ttl)
+  {
+    if (lru8_too_long (key) || lru8_too_long (val))
+    {
+      return false;                           // could never be read back (see lru8_fixed_string)
+    }
+
+    // if key exists (expired or not), update value
+    uint8_t idx = this->probe (key, h);
+    if (idx != IDX_INVALID)
+    {
+      m_val [idx] = val;
+      this->set_matrix_mru (idx);
+      this->stamp (idx, ttl);
+      m_flags.set_dirty (idx, true);
+      m_stats.on_update ();
+      return true;
+    }
+
+    idx = this->get_victim ();
+    if (!this->admits (idx, h, admit))
+    {
+      return false;
+    }
+
+    idx = this->replace (h, idx);
+    this->set (idx, key, val, h);
+    this->stamp (idx, ttl);
+    m_flags.set_dirty (idx, true);
+    return true;
+  }
+
+#if LRUCACHE8_CPP11
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (_Key &&key, _Val &&val, uint32_t h)
+  {
+    this->write_forward (std::move (key), std::move (val), h, lru8_admit_all (), m_expiry.ttl ());
+  }
+
+  void write (const _Key &key, _Val &&val, uint32_t h)
+  {
+    this->write_forward (key, std::move (val), h, lru8_admit_all (), m_expiry.ttl ());
+  }
+
+  template<typename _Admit> bool write_admit (_Key &&key, _Val &&val, uint32_t h, const _Admit &admit)
+  {
+    return this->write_forward (std::move (key), std::move (val), h, admit, m_expiry.ttl ());
+  }
+
+  template<typename _Admit> bool write_admit (const _Key &key, _Val &&val, uint32_t h, const _Admit &admit)
+  {
+    return this->write_forward (key, std::move (val), h, admit, m_expiry.ttl ());
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  template<typename... _Args> bool emplace_hashed (uint32_t h, const _Key &key, _Args&&... args)
+  {
+    if (lru8_too_long (key))
+    {
+      return false;
+    }
+
+    if (lru8_length_checked<_Val>::ENABLED)
+    {
+      // a value that may be too long is built and checked first (then copied: it is inline)
+      _Val val (std::forward<_Args>(args)...);
+      if (lru8_too_long (val))
+      {
+        return false;
+      }
+
+      this->emplace_way (h, key, std::move (val));
+    }
+    else
+    {
+      this->emplace_way (h, key, std::forward<_Args>(args)...);
+    }
+
+    return true;
+  }
+
+#endif
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val, uint32_t h)
+  {
+    uint8_t idx = this->lookup (key, h);
+    if (idx == IDX_INVALID)
+    {
+      return false;
+    }
+
+    *val = m_val [idx];
+    this->set_matrix_mru (idx);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  _Val *find (const _Key &key, uint32_t h)
+  {
+    uint8_t idx = this->lookup (key, h);
+    if (idx == IDX_INVALID)
+    {
+      return NULL;
+    }
+
+    this->set_matrix_mru (idx);
+    return &m_val [idx];
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  const _Val *peek (const _Key &key, uint32_t h) const
+  {
+    uint8_t idx = this->lookup (key, h);
+    return (idx != IDX_INVALID) ? &m_val [idx] : NULL;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // for containers choosing between sets (see lru8_place_two): is 'key' stored here
+  // (expired or not)? Not counted as a hit, a miss or a probe: the lookup that follows is.
+
+  bool contains (const _Key &key, uint32_t h) const
+  {
+    lru8_stats_none quiet;
+    return m_keys.find (ways_t::match (m_tags, make_tag (h)), key, h, m_kequal, quiet) != IDX_INVALID;
+  }
+
+  // can a new key move in without evicting a live entry (an empty or expired way)?
+
+  bool has_free_way () const
+  {
+    if (ways_t::match (m_tags, 0))
+    {
+      return true;
+    }
+
+    if (_Expiry::ENABLED)
+    {
+      uint32_t now = m_expiry.now ();
+      for (uint8_t i = 0; i < _Ways; ++i)
+      {
+        if (m_stamps.expired (i, now))
+        {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool erase (const _Key &key, uint32_t h)
+  {
+    uint8_t idx = this->probe (key, h);
+    if (idx == IDX_INVALID)
+    {
+      return false;
+    }
+
+    // an empty tag never matches, so no other way needs fixing up; reset the node so
+    // it lets go of whatever the key and value hold
+    ways_t::set_tag (m_tags, idx, 0);
+    policy_t::on_erase (m_matrix, idx);
+    m_keys.m_key [idx] = _Key ();
+    m_val [idx] = _Val ();
+    m_flags.set_dirty (idx, false);
+    m_stats.on_erase ();
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  template<typename _Loader> _Val &get_or_load (const _Key &key, _Loader loader, uint32_t h)
+  {
+    uint8_t idx = this->probe (key, h);       // never finds a too long key
+    if ((idx != IDX_INVALID) && !this->expired (idx))
+    {
+      m_stats.on_hit ();
+      this->set_matrix_mru (idx);
+      return m_val [idx];
+    }
+
+    m_stats.on_miss ();
+
+    // load before claiming a way, so a throwing loader leaves the cache untouched
+    _Val val (loader (key));
+    if (lru8_too_long (key) || lru8_too_long (val))
+    {
+      // not cached (see lru8_fixed_string), but still returned
+      _Val &refused = lru8_refused_slot<_Val> ();
+#if LRUCACHE8_CPP11
+      refused = std::move (val);
+#else
+      refused = val;
+#endif
+      return refused;
+    }
+
+    if (idx != IDX_INVALID)
+    {
+      // an expired entry for 'key' is reloaded in place, once it is counted and handed to the
+      // eviction handler as replace () would (which writes back an unsaved value)
+      this->set_matrix_mru (idx);
+      m_stats.on_evict ();
+      m_stats.on_insert ();
+      if (_Evict::ENABLED)
+      {
+        m_evict.evict (m_keys.m_key [idx], m_val [idx], m_flags.dirty (idx));
+        m_keys.m_key [idx] = key;
+      }
+    }
+    else
+    {
+      idx = this->replace (h);
+      m_keys.m_key [idx] = key;
+      m_keys.set_hash (idx, h);
+    }
+
+#if LRUCACHE8_CPP11
+    m_val [idx] = std::move (val);
+#else
+    m_val [idx] = val;
+#endif
+    this->stamp (idx, m_expiry.ttl ());
+    m_flags.set_dirty (idx, false);
+    return m_val [idx];
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void clear ()
+  {
+    this->new_matrix ();
+    ways_t::clear_tags (m_tags);
+    m_flags.clear ();
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // write back: pass every dirty entry to 'sink (key, value)' and mark it clean; returns
+  // how many were passed (always 0 without lru8_evict_to)
+
+  template<typename _Sink> uint32_t flush (_Sink sink)
+  {
+    uint32_t n = 0;
+    if (m_flags.any ())
+    {
+      for (uint8_t i = 0; i < _Ways; ++i)
+      {
+        if (m_flags.dirty (i) && ways_t::get_tag (m_tags, i))
+        {
+          sink (static_cast<const _Key &>(m_keys.m_key [i]), static_cast<const _Val &>(m_val [i]));
+          m_flags.set_dirty (i, false);
+          ++n;
+        }
+      }
+    }
+
+    return n;
+  }
+
+  // the '_Evict' policy (the handler's state, for lru8_evict_to)
+
+  _Evict &eviction ()
+  {
+    return m_evict;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // all zeros unless '_Stats' is lru8_stats_counters (or another collecting policy)
+
+  lru8_stats stats () const
+  {
+    return m_stats.snapshot ();
+  }
+
+  void reset_stats ()
+  {
+    m_stats.reset ();
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // time to live for writes without their own (write, emplace, get_or_load), in ticks of
+  // the '_Expiry' clock; 0 (the default) never expires. Ignored by lru8_expiry_none.
+
+  void set_ttl (uint32_t ticks)
+  {
+    m_expiry.set_ttl (ticks);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // start pulling the header line (tags, hashes) and the keys into cache ahead of a lookup
+
+  void prefetch () const
+  {
+    _lc8_prefetch (&m_tags);
+    _lc8_prefetch (&m_keys.m_key [0]);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache8 ()
+  {
+    this->clear ();
+  }
+
+private:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  static uint8_t make_tag (uint32_t h)
+  {
+    // high bit marks the way as occupied, so an empty (zero) tag never matches
+    return static_cast<uint8_t>(0x80 | (h & 0x7f));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void set_tag (uint8_t i, uint32_t h)
+  {
+    ways_t::set_tag (m_tags, i, make_tag (h));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // evict the victim way (see get_victim) for a new entry with hash 'h' and tag it
+
+  uint8_t replace (uint32_t h)
+  {
+    return this->replace (h, this->get_victim ());
+  }
+
+  uint8_t replace (uint32_t h, uint8_t idx)
+  {
+    if (ways_t::get_tag (m_tags, idx) && !this->expired (idx))
+    {
+      policy_t::on_replace (m_matrix, idx);   // the policy's own victim, not an empty or expired way
+    }
+
+    if (ways_t::get_tag (m_tags, idx))
+    {
+      m_stats.on_evict ();
+      m_evict.evict (m_keys.m_key [idx], m_val [idx], m_flags.dirty (idx));
+    }
+
+    m_stats.on_insert ();
+    this->set_tag (idx, h);
+    policy_t::on_insert (m_matrix, idx);
+    return idx;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // may a new entry with hash 'h' take way 'victim'? (an empty or expired way always may)
+
+  template<typename _Admit> bool admits (uint8_t victim, uint32_t h, const _Admit &admit)
+  {
+    if (!ways_t::get_tag (m_tags, victim) || this->expired (victim) || admit.admit (h, m_keys.hash (victim, m_khash)))
+    {
+      return true;
+    }
+
+    m_stats.on_reject ();
+    return false;
+  }
+
+#if LRUCACHE8_CPP11
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // emplace for a key and value known to fit: insert or update 'key' and construct its
+  // value from 'args' in place
+
+  template<typename... _Args> void emplace_way (uint32_t h, const _Key &key, _Args&&... args)
+  {
+    uint8_t idx = this->probe (key, h);
+    if (idx != IDX_INVALID)
+    {
+      this->set_matrix_mru (idx);
+      m_stats.on_update ();
+    }
+    else
+    {
+      idx = this->replace (h);
+      m_keys.m_key [idx] = key;
+      m_keys.set_hash (idx, h);
+    }
+
+    this->stamp (idx, m_expiry.ttl ());
+    m_flags.set_dirty (idx, true);
+
+    _Val *v = &m_val [idx];
+    if (std::is_nothrow_constructible<_Val, _Args&&...>::value)
+    {
+      v->~_Val ();
+      new (v) _Val (std::forward<_Args>(args)...);
+    }
+    else
+    {
+      // a throwing constructor must not leave a destroyed value behind
+      *v = _Val (std::forward<_Args>(args)...);
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  template<typename _K, typename _V, typename _Admit> bool write_forward (_K &&key, _V &&val, uint32_t h, const _Admit &admit, uint32_t ttl)
+  {
+    if (lru8_too_long (key) || lru8_too_long (val))
+    {
+      return false;
+    }
+
+    uint8_t idx = this->probe (key, h);
+    if (idx != IDX_INVALID)
+    {
+      m_val [idx] = std::forward<_V>(val);
+      this->set_matrix_mru (idx);
+      this->stamp (idx, ttl);
+      m_flags.set_dirty (idx, true);
+      m_stats.on_update ();
+      return true;
+    }
+
+    idx = this->get_victim ();
+    if (!this->admits (idx, h, admit))
+    {
+      return false;
+    }
+
+    idx = this->replace (h, idx);
+    this->set (idx, std::forward<_K>(key), std::forward<_V>(val), h);
+    this->stamp (idx, ttl);
+    m_flags.set_dirty (idx, true);
+    return true;
+  }
+
+#endif
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void set (uint8_t idx, const _Key &key, const _Val &val, uint32_t h)
+  {
+    m_keys.m_key [idx] = key;
+    m_keys.set_hash (idx, h);
+    m_val [idx] = val;
+  }
+
+#if LRUCACHE8_CPP11
+  template<typename _K, typename _V> void set (uint8_t idx, _K &&key, _V &&val, uint32_t h)
+  {
+    m_keys.m_key [idx] = std::forward<_K>(key);
+    m_keys.set_hash (idx, h);
+    m_val [idx] = std::forward<_V>(val);
+  }
+#endif
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  uint8_t probe (const _Key &key, uint32_t h) const
+  {
+    // compare all tags at once; only ways whose tag matches get a full compare
+    typename ways_t::mask_t match = ways_t::match (m_tags, make_tag (h));
+    return m_keys.find (match, key, h, m_kequal, m_stats);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // probe for a live entry: an expired one is a miss
+
+  uint8_t lookup (const _Key &key, uint32_t h) const
+  {
+    uint8_t idx = this->probe (key, h);
+    if ((idx != IDX_INVALID) && !this->expired (idx))
+    {
+      m_stats.on_hit ();
+      return idx;
+    }
+
+    m_stats.on_miss ();
+    return IDX_INVALID;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool expired (uint8_t idx) const
+  {
+    return _Expiry::ENABLED && m_stamps.expired (idx, m_expiry.now ());
+  }
+
+  void stamp (uint8_t idx, uint32_t ttl)
+  {
+    m_stamps.set_deadline (idx, _Expiry::deadline (m_expiry.now (), ttl));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void new_matrix ()
+  {
+    policy_t::init (m_matrix);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  uint8_t get_matrix_lru () const
+  {
+    return policy_t::victim (m_matrix);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  uint8_t get_victim () const
+  {
+    // an empty way goes first (an erase may have left the policy's victim on a live one),
+    // then an expired way, then the policy's victim
+    typename ways_t::mask_t empty = ways_t::match (m_tags, 0);
+    if (empty)
+    {
+      return ways_t::index (ways_t::lowest (empty));
+    }
+
+    if (_Expiry::ENABLED)
+    {
+      uint32_t now = m_expiry.now ();
+      for (uint8_t i = 0; i < _Ways; ++i)
+      {
+        if (ways_t::get_tag (m_tags, i) && m_stamps.expired (i, now))
+        {
+          return i;
+        }
+      }
+    }
+
+    return this->get_matrix_lru ();
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void set_matrix_mru (uint8_t i)
+  {
+    policy_t::on_access (m_matrix, i);
   }
 
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////
 
-  node_t      m_node [MAX_SIZE];
-  uint8_t     m_lmap [MAX_SIZE];
-  uint64_t    m_matrix;
-  _KeyHash    m_khash;
-  _KeyEqual   m_kequal;
+  // hot: everything a probe or a replacement reads before it knows which way to touch,
+  // together at the head (within one cache line for 8 ways, whatever the policy), then
+  // the keys: behind their hashes (only read on a tag match), or packed in their place
+  typename ways_t::tags_t       m_tags;
+  typename policy_t::state_t    m_matrix;
+  keys_t                        m_keys;
+
+  // cold: a value is only read on a hit
+  _Val                          m_val [MAX_SIZE];
+
+  // policies: the default ones are empty, and take no storage (see LRUCACHE8_NO_UNIQUE_ADDRESS)
+  LRUCACHE8_NO_UNIQUE_ADDRESS typename _Expiry::template stamps_t<_Ways> m_stamps;
+  LRUCACHE8_NO_UNIQUE_ADDRESS typename _Evict::template flags_t<_Ways>   m_flags;
+  LRUCACHE8_NO_UNIQUE_ADDRESS _KeyHash          m_khash;
+  LRUCACHE8_NO_UNIQUE_ADDRESS _KeyEqual         m_kequal;
+  LRUCACHE8_NO_UNIQUE_ADDRESS mutable _Stats    m_stats;
+  LRUCACHE8_NO_UNIQUE_ADDRESS _Expiry           m_expiry;
+  LRUCACHE8_NO_UNIQUE_ADDRESS _Evict            m_evict;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,366 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Copyright (c) 2015 Ubaka Onyechi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LRUCACHE8_CONCURRENT_H
+#define LRUCACHE8_CONCURRENT_H
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "lru_cache8.h"
+
+#if !LRUCACHE8_CPP11
+#error "lru_cache8_concurrent requires C++11"
+#endif
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Thread-safe lru_cache8 with lock-free reads.
+//
+// Writers serialize on a sequence lock (odd == write in progress). Readers never block: they
+// probe and copy the value out optimistically, then retry if the sequence changed underneath
+// them. A hit promotes its way with a single CAS on the reference matrix, so concurrent hits
+// never lose each other's updates or leave the matrix without an LRU row.
+//
+// Readers may observe a node while it is being overwritten, hence keys and values must be
+// trivially copyable, and '_KeyEqual' must be safe to call on any key that was ever stored.
+
+#if LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS
+template<typename _Key, typename _Val, typename _KeyHash = std::hash<_Key>, typename _KeyEqual = std::equal_to<_Key> >
+#else
+template<typename _Key, typename _Val, typename _KeyHash = LRU8Hash<_Key>, typename _KeyEqual = LRU8EqualTo<_Key> >
+#endif
+
+class lru_cache8_concurrent
+{
+  static_assert (std::is_trivially_copyable<_Key>::value, "lru_cache8_concurrent requires a trivially copyable key");
+  static_assert (std::is_trivially_copyable<_Val>::value, "lru_cache8_concurrent requires a trivially copyable value");
+
+public:
+
+  static const uint8_t MAX_SIZE = sizeof (uint64_t);
+
+private:
+
+  static const uint8_t MAX_SIZE_MINUS_1 = MAX_SIZE - 1;
+  static const uint8_t IDX_INVALID = 0xff;
+
+  struct node_t
+  {
+    _Key      m_key;
+    _Val      m_val;
+    uint32_t  m_hash;
+
+    node_t () : m_hash (0) {}
+  };
+
+public:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (const _Key &key, const _Val &val)
+  {
+    this->write (key, val, (uint32_t) this->m_khash (key));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val)
+  {
+    return this->read (key, val, (uint32_t) this->m_khash (key));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (const _Key &key, const _Val &val, uint32_t h)
+  {
+    if (lru8_too_long (key) || lru8_too_long (val))
+    {
+      return;                                 // see lru8_fixed_string
+    }
+
+    uint32_t seq = this->write_lock ();
+
+    uint8_t idx = this->probe (key, h);
+    if (idx != IDX_INVALID)
+    {
+      m_node [idx].m_val = val;
+      this->set_matrix_mru (idx);
+      this->write_unlock (seq);
+      return;
+    }
+
+    uint8_t lru_idx = lru8_matrix::get_lru (m_matrix.load (std::memory_order_relaxed));
+    uint8_t shift = lru_idx << 3;
+    uint64_t tags = m_tags.load (std::memory_order_relaxed);
+    m_tags.store ((tags & ~(0xffull << shift)) | (static_cast<uint64_t>(make_tag (h)) << shift), std::memory_order_relaxed);
+
+    node_t *n = &m_node [lru_idx];
+    n->m_key = key;
+    n->m_val = val;
+    n->m_hash = h;
+    this->set_matrix_mru (lru_idx);
+
+    this->write_unlock (seq);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val, uint32_t h)
+  {
+    uint8_t idx = IDX_INVALID;
+    if (!this->peek (key, val, h, &idx))
+    {
+      return false;
+    }
+
+    this->set_matrix_mru (idx);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // read without promoting; the way that hit is returned so the caller can
+  // defer the recency update (see touch) instead of writing the matrix now
+
+  bool peek (const _Key &key, _Val *val, uint32_t h, uint8_t *way) const
+  {
+    for (;;)
+    {
+      uint32_t seq = m_seq.load (std::memory_order_acquire);
+      if (seq & 1)
+      {
+        std::this_thread::yield ();
+        continue;
+      }
+
+      uint8_t idx = this->probe (key, h);
+      _Val tmp = _Val ();
+      if (idx != IDX_INVALID)
+      {
+        tmp = m_node [idx].m_val;
+      }
+
+      std::atomic_thread_fence (std::memory_order_acquire);
+      if (m_seq.load (std::memory_order_relaxed) != seq)
+      {
+        continue;
+      }
+
+      if (idx == IDX_INVALID)
+      {
+        return false;
+      }
+
+      *val = tmp;
+      *way = idx;
+      return true;
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void touch (uint8_t way)
+  {
+    this->set_matrix_mru (way & MAX_SIZE_MINUS_1);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // remove 'key' (returns false if it was not cached); its way becomes the LRU
+
+  bool erase (const _Key &key, uint32_t h)
+  {
+    uint32_t seq = this->write_lock ();
+
+    uint8_t idx = this->probe (key, h);
+    if (idx != IDX_INVALID)
+    {
+      uint8_t shift = idx << 3;
+      uint64_t tags = m_tags.load (std::memory_order_relaxed);
+      m_tags.store (tags & ~(0xffull << shift), std::memory_order_relaxed);
+
+      uint64_t m = m_matrix.load (std::memory_order_relaxed);
+      while (!m_matrix.compare_exchange_weak (m, lru8_matrix::set_lru (m, idx), std::memory_order_relaxed))
+      {
+      }
+    }
+
+    this->write_unlock (seq);
+    return (idx != IDX_INVALID);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void clear ()
+  {
+    uint32_t seq = this->write_lock ();
+    m_matrix.store (lru8_matrix::init (), std::memory_order_relaxed);
+    m_tags.store (0, std::memory_order_relaxed);
+    this->write_unlock (seq);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache8_concurrent () : m_tags (0), m_matrix (lru8_matrix::init ()), m_seq (0) {}
+
+private:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  static uint8_t make_tag (uint32_t h)
+  {
+    return static_cast<uint8_t>(0x80 | (h & 0x7f));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  uint8_t probe (const _Key &key, uint32_t h) const
+  {
+    uint64_t tags = m_tags.load (std::memory_order_relaxed);
+    uint64_t match = lru8_swar::zero_bytes (tags ^ lru8_swar::broadcast (make_tag (h)));
+    while (match)
+    {
+      uint8_t idx = lru8_swar::byte_index (lru8_swar::lowest (match));
+      const node_t *n = &m_node [idx];
+      if ((n->m_hash == h) && this->m_kequal (n->m_key, key))
+      {
+        return idx;
+      }
+
+      match &= match - 1;
+    }
+
+    return IDX_INVALID;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void set_matrix_mru (uint8_t i)
+  {
+    // row set and column clear must land together or racing hits can
+    // leave the matrix with no zero row (no LRU) or with two
+    uint64_t m = m_matrix.load (std::memory_order_relaxed);
+    while (!m_matrix.compare_exchange_weak (m, lru8_matrix::set_mru (m, i), std::memory_order_relaxed))
+    {
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  uint32_t write_lock ()
+  {
+    uint32_t seq = m_seq.load (std::memory_order_relaxed);
+    for (;;)
+    {
+      if (!(seq & 1) && m_seq.compare_exchange_weak (seq, seq + 1, std::memory_order_acquire))
+      {
+        break;
+      }
+
+      std::this_thread::yield ();
+      seq = m_seq.load (std::memory_order_relaxed);
+    }
+
+    // keep node stores from being reordered above the odd sequence number
+    std::atomic_thread_fence (std::memory_order_release);
+    return seq + 1;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write_unlock (uint32_t seq)
+  {
+    m_seq.store (seq + 1, std::memory_order_release);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache8_concurrent (const lru_cache8_concurrent &);
+  lru_cache8_concurrent &operator= (const lru_cache8_concurrent &);
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  node_t                m_node [MAX_SIZE];
+  std::atomic<uint64_t> m_tags;
+  std::atomic<uint64_t> m_matrix;
+  std::atomic<uint32_t> m_seq;
+  _KeyHash              m_khash;
+  _KeyEqual             m_kequal;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,501 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Copyright (c) 2015 Ubaka Onyechi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LRUCACHE_SA_H
+#define LRUCACHE_SA_H
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "lru_cache8.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Set placement policies, selected by lru_cache_sa's '_Place' parameter. Both are constructed
+// with the set count and expose:
+//
+//  CHOICES               how many sets a key may live in (1 or 2)
+//  index (h, c)          candidate set c of the key with hash h
+//  choose (s0, free0, s1, free1)   the candidate to insert a new key in, given whether each
+//                        has a free way
+//  placed (s)            a new key was inserted in set s (not called for a refused write)
+//
+// lru8_place_one (the default) maps every key to a single set and compiles away.
+// lru8_place_two maps every key to two sets, picked by independent multiply-shifts of its hash
+// (skewed associativity), so keys that crowd one set can spill into another. A new key goes
+// to a candidate with a free way, else to the one that took a new key longer ago, whose
+// victim is then likely the older of the two. This costs a 32-bit stamp per set, and a
+// lookup probes the second set when the first does not hold the key.
+
+struct lru8_place_one
+{
+  static const uint32_t CHOICES = 1;
+
+  template<uint32_t _Sets> static uint32_t index (uint32_t h, uint32_t)
+  {
+    // the set's own probe uses the low-order bits of 'h', so scramble them into
+    // the high-order bits and scale those to [0, _Sets) (multiply-shift, no modulo)
+    uint32_t m = h * 0x9e3779b1u;
+    return static_cast<uint32_t>((static_cast<uint64_t>(m) * _Sets) >> 32);
+  }
+
+  uint32_t choose (uint32_t s0, bool, uint32_t, bool) const { return s0; }
+  void placed (uint32_t) {}
+  void clear () {}
+
+  explicit lru8_place_one (uint32_t) {}
+};
+
+struct lru8_place_two
+{
+  static const uint32_t CHOICES = 2;
+
+  template<uint32_t _Sets> static uint32_t index (uint32_t h, uint32_t c)
+  {
+    // the second choice multiplies by another odd constant after folding the high bits
+    // down, so keys sharing their first set are spread over all the others
+    uint32_t m = c ? ((h ^ (h >> 16)) * 0x2c1b3c6du) : (h * 0x9e3779b1u);
+    return static_cast<uint32_t>((static_cast<uint64_t>(m) * _Sets) >> 32);
+  }
+
+  uint32_t choose (uint32_t s0, bool free0, uint32_t s1, bool free1) const
+  {
+    return (free0 != free1) ? (free0 ? s0 : s1) : ((static_cast<int32_t>(m_stamp [s1] - m_stamp [s0]) < 0) ? s1 : s0);
+  }
+
+  void placed (uint32_t s)
+  {
+    m_stamp [s] = ++m_tick;
+  }
+
+  void clear ()
+  {
+    memset (m_stamp, 0, m_sets * sizeof (uint32_t));
+    m_tick = 0;
+  }
+
+  explicit lru8_place_two (uint32_t sets) : m_stamp (new uint32_t [sets]), m_sets (sets), m_tick (0)
+  {
+    this->clear ();
+  }
+
+  ~lru8_place_two ()
+  {
+    delete [] m_stamp;
+  }
+
+private:
+
+  lru8_place_two (const lru8_place_two &);
+  lru8_place_two &operator= (const lru8_place_two &);
+
+  uint32_t   *m_stamp;                        // tick at which each set last took a new key
+  uint32_t    m_sets;
+  uint32_t    m_tick;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Set-associative LRU cache: each key maps to one of '_Sets' lru_cache8 sets (or one of two,
+// with lru8_place_two), so every operation touches a single 8-way set regardless of total
+// capacity. '_Admit' (lru8_admit_all or lru8_tinylfu) sees every access and can refuse a
+// write that would evict a more popular entry; get_or_load and emplace always insert.
+
+#if LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS
+template<typename _Key, typename _Val, uint32_t _Sets, typename _KeyHash = std::hash<_Key>, typename _KeyEqual = std::equal_to<_Key>,
+  typename _Set = lru_cache8<_Key, _Val, _KeyHash, _KeyEqual>, typename _Admit = lru8_admit_all, typename _Place = lru8_place_one>
+#else
+template<typename _Key, typename _Val, uint32_t _Sets, typename _KeyHash = LRU8Hash<_Key>, typename _KeyEqual = LRU8EqualTo<_Key>,
+  typename _Set = lru_cache8<_Key, _Val, _KeyHash, _KeyEqual>, typename _Admit = lru8_admit_all, typename _Place = lru8_place_one>
+#endif
+
+class lru_cache_sa
+{
+public:
+
+  typedef _Set set_type;
+
+  static const uint32_t SET_COUNT = _Sets;
+  static const uint32_t MAX_SIZE = _Sets * _Set::MAX_SIZE;
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (const _Key &key, const _Val &val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    bool fresh;
+    uint32_t s = this->place (key, h, fresh);
+    if (m_set [s].write_admit (key, val, h, m_admit) && fresh)
+    {
+      m_place.placed (s);
+    }
+  }
+
+  // per-entry and default time to live, for sets with an lru8_expiry policy
+
+  void write_ttl (const _Key &key, const _Val &val, uint32_t ttl)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    bool fresh;
+    uint32_t s = this->place (key, h, fresh);
+    if (m_set [s].write_admit (key, val, h, m_admit, ttl) && fresh)
+    {
+      m_place.placed (s);
+    }
+  }
+
+  void set_ttl (uint32_t ticks)
+  {
+    for (uint32_t s = 0; s < _Sets; ++s)
+    {
+      m_set [s].set_ttl (ticks);
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    return m_set [this->find_set (key, h)].read (key, val, h);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // batched read: hashes a group of keys and prefetches their sets before probing any
+  // of them, so the cache misses of a group overlap instead of stalling one at a time.
+  // out [i] is written for hits only; bit i of hit_mask ((n + 63) / 64 words) marks them.
+
+  uint32_t read_many (const _Key *keys, uint32_t n, _Val *out, uint64_t *hit_mask)
+  {
+    static const uint32_t BATCH_SIZE = 16;
+
+    uint32_t hash [BATCH_SIZE];
+    uint32_t set [BATCH_SIZE];
+    uint32_t alt [BATCH_SIZE];
+    uint32_t hits = 0;
+
+    memset (hit_mask, 0, ((n + 63) >> 6) * sizeof (uint64_t));
+
+    for (uint32_t b = 0; b < n; b += BATCH_SIZE)
+    {
+      uint32_t c = ((n - b) < BATCH_SIZE) ? (n - b) : BATCH_SIZE;
+
+      for (uint32_t i = 0; i < c; ++i)
+      {
+        hash [i] = (uint32_t) this->m_khash (keys [b + i]);
+        set [i] = _Place::template index<_Sets> (hash [i], 0);
+        m_admit.record (hash [i]);
+        m_set [set [i]].prefetch ();
+        if (_Place::CHOICES > 1)
+        {
+          alt [i] = _Place::template index<_Sets> (hash [i], 1);
+          m_set [alt [i]].prefetch ();
+        }
+      }
+
+      for (uint32_t i = 0; i < c; ++i)
+      {
+        uint32_t k = b + i;
+        if ((_Place::CHOICES > 1) && !m_set [set [i]].contains (keys [k], hash [i]))
+        {
+          set [i] = alt [i];
+        }
+
+        if (m_set [set [i]].read (keys [k], &out [k], hash [i]))
+        {
+          hit_mask [k >> 6] |= 1ull << (k & 63);
+          ++hits;
+        }
+      }
+    }
+
+    return hits;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  _Val *find (const _Key &key)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    return m_set [this->find_set (key, h)].find (key, h);
+  }
+
+  const _Val *peek (const _Key &key) const
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    return m_set [this->find_set (key, h)].peek (key, h);
+  }
+
+  bool erase (const _Key &key)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    return m_set [this->find_set (key, h)].erase (key, h);
+  }
+
+  template<typename _Loader> _Val &get_or_load (const _Key &key, _Loader loader)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    bool fresh;
+    uint32_t s = this->place (key, h, fresh);
+    _Val &val = m_set [s].get_or_load (key, loader, h);
+    if (fresh && !lru8_too_long (key) && !lru8_too_long (val))
+    {
+      m_place.placed (s);
+    }
+    return val;
+  }
+
+#if LRUCACHE8_CPP11
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (_Key &&key, _Val &&val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    bool fresh;
+    uint32_t s = this->place (key, h, fresh);
+    if (m_set [s].write_admit (std::move (key), std::move (val), h, m_admit) && fresh)
+    {
+      m_place.placed (s);
+    }
+  }
+
+  void write (const _Key &key, _Val &&val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    bool fresh;
+    uint32_t s = this->place (key, h, fresh);
+    if (m_set [s].write_admit (key, std::move (val), h, m_admit) && fresh)
+    {
+      m_place.placed (s);
+    }
+  }
+
+  template<typename... _Args> bool emplace (const _Key &key, _Args&&... args)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    m_admit.record (h);
+    bool fresh;
+    uint32_t s = this->place (key, h, fresh);
+    if (!m_set [s].emplace_hashed (h, key, std::forward<_Args>(args)...))
+    {
+      return false;
+    }
+
+    if (fresh)
+    {
+      m_place.placed (s);
+    }
+    return true;
+  }
+
+#endif
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void clear ()
+  {
+    for (uint32_t s = 0; s < _Sets; ++s)
+    {
+      m_set [s].clear ();
+    }
+
+    m_admit.clear ();
+    m_place.clear ();
+  }
+
+  // write back the dirty entries of every set in one pass (see lru8_evict_to); each set
+  // keeps its own default-constructed handler, so handlers should share state through
+  // pointers or statics
+
+  template<typename _Sink> uint32_t flush (_Sink sink)
+  {
+    uint32_t n = 0;
+    for (uint32_t s = 0; s < _Sets; ++s)
+    {
+      n += m_set [s].template flush<_Sink &> (sink);
+    }
+    return n;
+  }
+
+  // merged over all sets (all zeros unless the sets collect statistics)
+
+  lru8_stats stats () const
+  {
+    lru8_stats total;
+    for (uint32_t s = 0; s < _Sets; ++s)
+    {
+      total.merge (m_set [s].stats ());
+    }
+    return total;
+  }
+
+  void reset_stats ()
+  {
+    for (uint32_t s = 0; s < _Sets; ++s)
+    {
+      m_set [s].reset_stats ();
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // all sets as one array (e.g. to snapshot them, see lru_cache_snapshot.h)
+
+  const _Set *sets () const
+  {
+    return m_set;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache_sa () : m_set (new _Set [_Sets]), m_admit (MAX_SIZE), m_place (_Sets), m_owner (true) {}
+
+  // run on '_Sets' sets owned by the caller (e.g. a mapped snapshot), which must outlive the cache
+
+  explicit lru_cache_sa (_Set *sets) : m_set (sets), m_admit (MAX_SIZE), m_place (_Sets), m_owner (false) {}
+
+  ~lru_cache_sa ()
+  {
+    if (m_owner)
+    {
+      delete [] m_set;
+    }
+  }
+
+private:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // the set holding 'key', if any does (with one choice, the key's only set)
+
+  uint32_t find_set (const _Key &key, uint32_t h) const
+  {
+    uint32_t s = _Place::template index<_Sets> (h, 0);
+    if (_Place::CHOICES > 1)
+    {
+      // start the second set on its way while the first is probed
+      uint32_t s1 = _Place::template index<_Sets> (h, 1);
+      m_set [s1].prefetch ();
+      if (!m_set [s].contains (key, h))
+      {
+        s = s1;
+      }
+    }
+
+    return s;
+  }
+
+  // the set holding 'key', or the set a new 'key' should go to ('fresh'; the caller reports
+  // it to m_place once the key is actually inserted)
+
+  uint32_t place (const _Key &key, uint32_t h, bool &fresh)
+  {
+    fresh = false;
+    uint32_t s0 = _Place::template index<_Sets> (h, 0);
+    if (_Place::CHOICES == 1)
+    {
+      return s0;
+    }
+
+    uint32_t s1 = _Place::template index<_Sets> (h, 1);
+    m_set [s1].prefetch ();
+    if (m_set [s0].contains (key, h))
+    {
+      return s0;
+    }
+
+    if (m_set [s1].contains (key, h))
+    {
+      return s1;
+    }
+
+    fresh = true;
+    return m_place.choose (s0, m_set [s0].has_free_way (), s1, m_set [s1].has_free_way ());
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache_sa (const lru_cache_sa &);
+  lru_cache_sa &operator= (const lru_cache_sa &);
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  _Set       *m_set;
+  _KeyHash    m_khash;
+  _Admit      m_admit;
+  _Place      m_place;
+  bool        m_owner;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
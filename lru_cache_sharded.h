@@ -0,0 +1,542 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Copyright (c) 2015 Ubaka Onyechi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LRUCACHE_SHARDED_H
+#define LRUCACHE_SHARDED_H
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "lru_cache8_concurrent.h"
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined (__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#include <coroutine>
+#define LRUCACHE8_COROUTINES
+#endif
+
+// Line-aligned read buffers, where 'new' honours over-alignment (C++17); before that the
+// padding alone keeps neighbouring buffers off each other's lines
+#if defined (__cpp_aligned_new) && (__cpp_aligned_new >= 201606L)
+#define LRUCACHE8_SHARDED_ALIGN alignas (64)
+#else
+#define LRUCACHE8_SHARDED_ALIGN
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Large concurrent set-associative cache.
+//
+// '_Sets' lru_cache8_concurrent sets are spread over '_Shards' locks. Reads are lock-free and
+// do not write the reference matrix: a hit is logged as a (set, way) event in a small ring
+// buffer owned by the reading thread's stripe, and the events are replayed into the matrices
+// in a batch by whoever next holds the shard lock (a writer, or a reader whose buffer filled
+// up). When a buffer is full and the shard is busy the event is dropped - recency is a hint,
+// and losing an occasional hit is cheaper than making readers wait.
+//
+// get_or_load coalesces concurrent misses: the first caller for a key runs the loader, later
+// callers wait for its result instead of hitting the backing storage again. With C++20,
+// async_get_or_load returns an awaitable for the same thing; suspended coroutines are resumed
+// on the thread that completed the load.
+
+#if LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS
+template<typename _Key, typename _Val, uint32_t _Sets, uint32_t _Shards = 16, typename _KeyHash = std::hash<_Key>, typename _KeyEqual = std::equal_to<_Key> >
+#else
+template<typename _Key, typename _Val, uint32_t _Sets, uint32_t _Shards = 16, typename _KeyHash = LRU8Hash<_Key>, typename _KeyEqual = LRU8EqualTo<_Key> >
+#endif
+
+class lru_cache_sharded
+{
+  static_assert ((_Shards > 0) && (_Sets >= _Shards), "lru_cache_sharded needs at least one set per shard");
+  static_assert (_Sets < (1u << 28), "lru_cache_sharded set index must fit a read buffer event");
+
+  typedef lru_cache8_concurrent<_Key, _Val, _KeyHash, _KeyEqual> set_t;
+
+  static const uint32_t STRIPE_COUNT = 8;
+  static const uint32_t BUFFER_SIZE = 32;
+  static const uint32_t BUFFER_SIZE_MINUS_1 = BUFFER_SIZE - 1;
+
+  // one buffer per three cache lines
+  struct LRUCACHE8_SHARDED_ALIGN buffer_t
+  {
+    std::atomic<uint32_t> m_event [BUFFER_SIZE]; // (set << 3 | way) + 1, 0 == not yet published
+    std::atomic<uint32_t> m_head;                // events claimed by readers
+    std::atomic<uint32_t> m_tail;                // events replayed (written under the shard lock)
+    uint8_t               m_pad [56];
+
+    buffer_t () : m_head (0), m_tail (0)
+    {
+      for (uint32_t i = 0; i < BUFFER_SIZE; ++i) { m_event [i].store (0, std::memory_order_relaxed); }
+    }
+  };
+
+  struct flight_t
+  {
+    std::mutex                              m_lock;
+    std::condition_variable                 m_cv;
+    bool                                    m_done;
+    _Val                                    m_val;
+    std::exception_ptr                      m_error;
+#ifdef LRUCACHE8_COROUTINES
+    std::vector<std::coroutine_handle<> >   m_waiters;
+#endif
+
+    flight_t () : m_done (false), m_val () {}
+  };
+
+  typedef std::shared_ptr<flight_t> flight_ptr;
+
+  struct shard_t
+  {
+    std::mutex  m_lock;
+    buffer_t    m_buffer [STRIPE_COUNT];
+    std::unordered_map<_Key, flight_ptr, _KeyHash, _KeyEqual> m_flight; // loads in progress
+  };
+
+public:
+
+  static const uint32_t SET_COUNT = _Sets;
+  static const uint32_t MAX_SIZE = _Sets * set_t::MAX_SIZE;
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (const _Key &key, const _Val &val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    uint32_t s = get_set_index (h);
+    shard_t *shard = &m_shard [s % _Shards];
+
+    std::lock_guard<std::mutex> lock (shard->m_lock);
+    this->drain (shard);
+    m_set [s].write (key, val, h);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    return this->read (key, val, h, get_set_index (h));
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool erase (const _Key &key)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    uint32_t s = get_set_index (h);
+    shard_t *shard = &m_shard [s % _Shards];
+
+    std::lock_guard<std::mutex> lock (shard->m_lock);
+    this->drain (shard);
+    return m_set [s].erase (key, h);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  template<typename _Loader> _Val get_or_load (const _Key &key, _Loader loader)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    uint32_t s = get_set_index (h);
+
+    _Val val = _Val ();
+    if (this->read (key, &val, h, s))
+    {
+      return val;
+    }
+
+    flight_ptr flight;
+    bool leader = false;
+    if (this->begin_load (key, h, s, &val, &flight, &leader))
+    {
+      return val;
+    }
+
+    if (leader)
+    {
+      this->run_load (key, h, s, flight, loader);
+    }
+
+    std::unique_lock<std::mutex> lock (flight->m_lock);
+    flight->m_cv.wait (lock, [&flight] () { return flight->m_done; });
+    if (flight->m_error)
+    {
+      std::rethrow_exception (flight->m_error);
+    }
+
+    return flight->m_val;
+  }
+
+#ifdef LRUCACHE8_COROUTINES
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  template<typename _Loader> class load_awaiter
+  {
+  public:
+
+    bool await_ready ()
+    {
+      return m_cache->read (m_key, &m_val, m_h, m_s);
+    }
+
+    bool await_suspend (std::coroutine_handle<> caller)
+    {
+      bool leader = false;
+      if (m_cache->begin_load (m_key, m_h, m_s, &m_val, &m_flight, &leader))
+      {
+        m_flight.reset ();
+        return false;
+      }
+
+      if (leader)
+      {
+        m_cache->run_load (m_key, m_h, m_s, m_flight, m_loader);
+        return false;
+      }
+
+      std::lock_guard<std::mutex> lock (m_flight->m_lock);
+      if (m_flight->m_done)
+      {
+        return false;
+      }
+
+      m_flight->m_waiters.push_back (caller);
+      return true;
+    }
+
+    _Val await_resume ()
+    {
+      if (!m_flight)
+      {
+        return m_val;
+      }
+
+      if (m_flight->m_error)
+      {
+        std::rethrow_exception (m_flight->m_error);
+      }
+
+      return m_flight->m_val;
+    }
+
+    load_awaiter (lru_cache_sharded *cache, const _Key &key, _Loader loader)
+      : m_cache (cache), m_key (key), m_loader (loader), m_val (), m_h ((uint32_t) cache->m_khash (key)), m_s (get_set_index (m_h)) {}
+
+  private:
+
+    lru_cache_sharded  *m_cache;
+    _Key                m_key;
+    _Loader             m_loader;
+    _Val                m_val;
+    flight_ptr          m_flight;
+    uint32_t            m_h;
+    uint32_t            m_s;
+  };
+
+  template<typename _Loader> load_awaiter<_Loader> async_get_or_load (const _Key &key, _Loader loader)
+  {
+    return load_awaiter<_Loader> (this, key, loader);
+  }
+
+#endif
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // replay every buffered hit now (e.g. before inspecting eviction order)
+
+  void flush ()
+  {
+    for (uint32_t i = 0; i < _Shards; ++i)
+    {
+      std::lock_guard<std::mutex> lock (m_shard [i].m_lock);
+      this->drain (&m_shard [i]);
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void clear ()
+  {
+    for (uint32_t i = 0; i < _Shards; ++i)
+    {
+      std::lock_guard<std::mutex> lock (m_shard [i].m_lock);
+      this->drain (&m_shard [i]);
+
+      for (uint32_t s = i; s < _Sets; s += _Shards)
+      {
+        m_set [s].clear ();
+      }
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache_sharded () : m_set (new set_t [_Sets]), m_shard (new shard_t [_Shards]) {}
+
+  ~lru_cache_sharded ()
+  {
+    delete [] m_shard;
+    delete [] m_set;
+  }
+
+private:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  static uint32_t get_set_index (uint32_t h)
+  {
+    uint32_t m = h * 0x9e3779b1u;
+    return static_cast<uint32_t>((static_cast<uint64_t>(m) * _Sets) >> 32);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val, uint32_t h, uint32_t s)
+  {
+    uint8_t way = 0;
+    if (!m_set [s].peek (key, val, h, &way))
+    {
+      return false;
+    }
+
+    this->record (&m_shard [s % _Shards], (s << 3 | way) + 1);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // true (with *val) if the key turned up after all; otherwise *flight is the load to wait
+  // for and *leader tells whether this caller has to run it
+
+  bool begin_load (const _Key &key, uint32_t h, uint32_t s, _Val *val, flight_ptr *flight, bool *leader)
+  {
+    shard_t *shard = &m_shard [s % _Shards];
+    std::lock_guard<std::mutex> lock (shard->m_lock);
+
+    typename std::unordered_map<_Key, flight_ptr, _KeyHash, _KeyEqual>::iterator it = shard->m_flight.find (key);
+    if (it != shard->m_flight.end ())
+    {
+      *flight = it->second;
+      *leader = false;
+      return false;
+    }
+
+    // a load may have completed between the caller's miss and taking the lock
+    uint8_t way = 0;
+    if (m_set [s].peek (key, val, h, &way))
+    {
+      m_set [s].touch (way);
+      return true;
+    }
+
+    *flight = std::make_shared<flight_t> ();
+    *leader = true;
+    shard->m_flight.insert (std::make_pair (key, *flight));
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  template<typename _Loader> void run_load (const _Key &key, uint32_t h, uint32_t s, const flight_ptr &flight, _Loader &loader)
+  {
+    _Val val = _Val ();
+    std::exception_ptr error;
+    try
+    {
+      val = loader (key);
+    }
+    catch (...)
+    {
+      error = std::current_exception ();
+    }
+
+    shard_t *shard = &m_shard [s % _Shards];
+    {
+      std::lock_guard<std::mutex> lock (shard->m_lock);
+      if (!error)
+      {
+        this->drain (shard);
+        m_set [s].write (key, val, h);
+      }
+
+      shard->m_flight.erase (key);
+    }
+
+#ifdef LRUCACHE8_COROUTINES
+    std::vector<std::coroutine_handle<> > waiters;
+#endif
+    {
+      std::lock_guard<std::mutex> lock (flight->m_lock);
+      flight->m_val = val;
+      flight->m_error = error;
+      flight->m_done = true;
+#ifdef LRUCACHE8_COROUTINES
+      waiters.swap (flight->m_waiters);
+#endif
+    }
+
+    flight->m_cv.notify_all ();
+#ifdef LRUCACHE8_COROUTINES
+    for (size_t i = 0; i < waiters.size (); ++i)
+    {
+      waiters [i].resume ();
+    }
+#endif
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  static uint32_t get_stripe_index ()
+  {
+    // threads are dealt stripes round-robin, so up to STRIPE_COUNT threads
+    // each log into a buffer (and cache line) of their own
+    static std::atomic<uint32_t> s_next (0);
+    static thread_local uint32_t t_stripe = s_next.fetch_add (1, std::memory_order_relaxed) % STRIPE_COUNT;
+    return t_stripe;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void record (shard_t *shard, uint32_t event)
+  {
+    buffer_t *b = &shard->m_buffer [get_stripe_index ()];
+
+    uint32_t head = b->m_head.load (std::memory_order_relaxed);
+    uint32_t tail = b->m_tail.load (std::memory_order_acquire);
+    if (((head - tail) < BUFFER_SIZE) && b->m_head.compare_exchange_strong (head, head + 1, std::memory_order_relaxed))
+    {
+      b->m_event [head & BUFFER_SIZE_MINUS_1].store (event, std::memory_order_release);
+      if ((head - tail) < BUFFER_SIZE_MINUS_1)
+      {
+        return;
+      }
+    }
+
+    // buffer full (or lost the race for the last slot): replay if nobody else is
+    if (shard->m_lock.try_lock ())
+    {
+      this->drain (shard);
+      shard->m_lock.unlock ();
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void drain (shard_t *shard)
+  {
+    for (uint32_t i = 0; i < STRIPE_COUNT; ++i)
+    {
+      buffer_t *b = &shard->m_buffer [i];
+
+      uint32_t tail = b->m_tail.load (std::memory_order_relaxed);
+      uint32_t head = b->m_head.load (std::memory_order_acquire);
+      while (tail != head)
+      {
+        // a slot is claimed before it is published; stop at the first one still in flight
+        uint32_t e = b->m_event [tail & BUFFER_SIZE_MINUS_1].exchange (0, std::memory_order_acquire);
+        if (e == 0)
+        {
+          break;
+        }
+
+        e -= 1;
+        m_set [e >> 3].touch (static_cast<uint8_t>(e & 7));
+        ++tail;
+      }
+
+      b->m_tail.store (tail, std::memory_order_release);
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache_sharded (const lru_cache_sharded &);
+  lru_cache_sharded &operator= (const lru_cache_sharded &);
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  set_t      *m_set;
+  shard_t    *m_shard;
+  _KeyHash    m_khash;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
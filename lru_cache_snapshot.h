@@ -0,0 +1,327 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Copyright (c) 2015 Ubaka Onyechi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LRUCACHE_SNAPSHOT_H
+#define LRUCACHE_SNAPSHOT_H
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "lru_cache8.h"
+
+#if !LRUCACHE8_CPP11
+#error "lru_cache_snapshot requires C++11"
+#endif
+
+#include <stdio.h>
+#include <string>
+#include <type_traits>
+
+#if defined (__unix__) || defined (__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LRUCACHE8_SNAPSHOT_MMAP
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Snapshots of lru_cache8 sets, for a warm restart.
+//
+// A snapshot file is a 64-byte header followed by the sets exactly as they are in memory (tags,
+// replacement state, keys, values, ...), so it can only be taken of sets whose keys and values
+// are trivially copyable, and only restored by a build with the same set layout, byte order and
+// hash function. The header records the layout and a checksum of the sets; a file that does not
+// match is refused rather than restored.
+//
+// 'map' restores without copying: the file is mapped copy-on-write, pages are read in as they
+// are first touched, and writes to the cache never reach the file. lru_cache_sa runs directly
+// on the mapped sets through its lru_cache_sa (_Set *) constructor.
+//
+// Values are restored bit for bit: pointers, handles and expiry deadlines from a clock that
+// restarted (lru8_clock_ticks) mean nothing to the new process. An lru_cache_sa admission
+// filter is not part of the snapshot and starts empty.
+
+static const uint32_t LRU8_SNAPSHOT_VERSION = 1;
+
+struct lru8_snapshot_header
+{
+  char      m_magic [8];                      // "LRU8SNAP"
+  uint32_t  m_version;                        // LRU8_SNAPSHOT_VERSION
+  uint32_t  m_byte_order;                     // 0x01020304, as written by the saving machine
+  uint32_t  m_set_size;                       // sizeof (_Set)
+  uint32_t  m_set_align;                      // alignof (_Set)
+  uint32_t  m_set_count;
+  uint32_t  m_ways;
+  uint32_t  m_key_size;
+  uint32_t  m_val_size;
+  uint32_t  m_hash_check;                     // the set's hasher applied to a default key
+  uint32_t  m_checksum;                       // lru8_hasher::bytes of the sets
+  uint64_t  m_payload_size;                   // m_set_size * m_set_count
+  uint8_t   m_pad [8];
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename _Set> class lru8_snapshot
+{
+  static_assert (std::is_trivially_copyable<typename _Set::key_type>::value, "lru8_snapshot requires a trivially copyable key");
+  static_assert (std::is_trivially_copyable<typename _Set::mapped_type>::value, "lru8_snapshot requires a trivially copyable value");
+  static_assert (std::is_trivially_copyable<_Set>::value, "lru8_snapshot requires trivially copyable sets (and set policies)");
+  static_assert (sizeof (lru8_snapshot_header) == 64, "lru8_snapshot_header must fill one cache line");
+  static_assert (alignof (_Set) <= sizeof (lru8_snapshot_header), "mapped sets must stay aligned behind the header");
+
+public:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // write 'count' sets to 'path'; the file is written beside it and renamed into place,
+  // so a reader never sees half a snapshot
+
+  static bool write (const char *path, const _Set *sets, uint32_t count)
+  {
+    lru8_snapshot_header h = make_header (sets, count);
+    std::string tmp = std::string (path) + ".tmp";
+
+    FILE *f = fopen (tmp.c_str (), "wb");
+    if (!f)
+    {
+      return false;
+    }
+
+    bool ok = (fwrite (&h, sizeof (h), 1, f) == 1) && (fwrite (sets, sizeof (_Set), count, f) == count);
+    ok = (fclose (f) == 0) && ok;
+    if (!ok || (rename (tmp.c_str (), path) != 0))
+    {
+      remove (tmp.c_str ());
+      return false;
+    }
+
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // copy a snapshot of exactly 'count' sets into 'sets'; on failure they are left cleared
+
+  static bool read (const char *path, _Set *sets, uint32_t count)
+  {
+    FILE *f = fopen (path, "rb");
+    if (!f)
+    {
+      return false;
+    }
+
+    lru8_snapshot_header h;
+    bool ok = (fread (&h, sizeof (h), 1, f) == 1) && matches (h, count) && (fread (sets, sizeof (_Set), count, f) == count);
+    fclose (f);
+
+    if (!ok || (h.m_checksum != checksum (sets, count)))
+    {
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        sets [i].clear ();
+      }
+      return false;
+    }
+
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  // map a snapshot of exactly 'count' sets; 'sets ()' is valid until unmap or destruction.
+  // Checking the checksum reads the whole file once; with verify == false only the header
+  // is checked and pages are read on demand. Without mmap the sets are read into memory.
+
+  bool map (const char *path, uint32_t count, bool verify = true)
+  {
+    this->unmap ();
+
+#ifdef LRUCACHE8_SNAPSHOT_MMAP
+    int fd = open (path, O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    struct stat st;
+    size_t size = sizeof (lru8_snapshot_header) + (size_t) count * sizeof (_Set);
+    void *base = MAP_FAILED;
+    if ((fstat (fd, &st) == 0) && (static_cast<uint64_t>(st.st_size) == size))
+    {
+      base = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close (fd);
+
+    if (base == MAP_FAILED)
+    {
+      return false;
+    }
+
+    const lru8_snapshot_header *h = static_cast<const lru8_snapshot_header *>(base);
+    _Set *sets = reinterpret_cast<_Set *>(static_cast<char *>(base) + sizeof (lru8_snapshot_header));
+    if (!matches (*h, count) || (verify && (h->m_checksum != checksum (sets, count))))
+    {
+      munmap (base, size);
+      return false;
+    }
+
+    m_base = base;
+    m_size = size;
+    m_sets = sets;
+    return true;
+#else
+    (void) verify;
+    _Set *sets = new _Set [count];
+    if (!read (path, sets, count))
+    {
+      delete [] sets;
+      return false;
+    }
+
+    m_sets = sets;
+    return true;
+#endif
+  }
+
+  void unmap ()
+  {
+#ifdef LRUCACHE8_SNAPSHOT_MMAP
+    if (m_base)
+    {
+      munmap (m_base, m_size);
+    }
+#else
+    delete [] m_sets;
+#endif
+    m_base = NULL;
+    m_size = 0;
+    m_sets = NULL;
+  }
+
+  _Set *sets () const
+  {
+    return m_sets;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru8_snapshot () : m_base (NULL), m_size (0), m_sets (NULL) {}
+
+  ~lru8_snapshot ()
+  {
+    this->unmap ();
+  }
+
+private:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  static lru8_snapshot_header make_header (const _Set *sets, uint32_t count)
+  {
+    lru8_snapshot_header h;
+    memset (&h, 0, sizeof (h));
+    memcpy (h.m_magic, "LRU8SNAP", 8);
+    h.m_version = LRU8_SNAPSHOT_VERSION;
+    h.m_byte_order = 0x01020304;
+    h.m_set_size = sizeof (_Set);
+    h.m_set_align = alignof (_Set);
+    h.m_set_count = count;
+    h.m_ways = _Set::MAX_SIZE;
+    h.m_key_size = sizeof (typename _Set::key_type);
+    h.m_val_size = sizeof (typename _Set::mapped_type);
+    h.m_hash_check = hash_check ();
+    h.m_checksum = checksum (sets, count);
+    h.m_payload_size = static_cast<uint64_t>(count) * sizeof (_Set);
+    return h;
+  }
+
+  static bool matches (const lru8_snapshot_header &h, uint32_t count)
+  {
+    lru8_snapshot_header e = make_header (NULL, count);
+    return (memcmp (h.m_magic, e.m_magic, 8) == 0) && (h.m_version == e.m_version) && (h.m_byte_order == e.m_byte_order) &&
+      (h.m_set_size == e.m_set_size) && (h.m_set_align == e.m_set_align) && (h.m_set_count == e.m_set_count) &&
+      (h.m_ways == e.m_ways) && (h.m_key_size == e.m_key_size) && (h.m_val_size == e.m_val_size) &&
+      (h.m_hash_check == e.m_hash_check) && (h.m_payload_size == e.m_payload_size);
+  }
+
+  static uint32_t checksum (const _Set *sets, uint32_t count)
+  {
+    return sets ? lru8_hasher::bytes (sets, static_cast<size_t>(count) * sizeof (_Set)) : 0;
+  }
+
+  static uint32_t hash_check ()
+  {
+    // a tripwire for a changed hash function: entries hashed differently would be unreachable
+    return (uint32_t) typename _Set::hasher () (typename _Set::key_type ());
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru8_snapshot (const lru8_snapshot &);
+  lru8_snapshot &operator= (const lru8_snapshot &);
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void       *m_base;
+  size_t      m_size;
+  _Set       *m_sets;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
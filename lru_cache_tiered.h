@@ -0,0 +1,273 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Copyright (c) 2015 Ubaka Onyechi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LRUCACHE_TIERED_H
+#define LRUCACHE_TIERED_H
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "lru_cache_sharded.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Two-level cache: a thread-local lru_cache8 (L1) in front of a shared lru_cache_sharded (L2).
+//
+// Keys are spread over '_Shards' epoch counters, each on a cache line of its own. write, erase
+// and a get_or_load that runs its loader bump the key's epoch after updating the L2 (an L1
+// copy can outlive the L2's), and every L1 entry remembers the epoch it was filled under. An
+// L1 hit is only used while that epoch is current, so it costs one load of a line that stays
+// shared (and is only written by writers) - no atomic read-modify-write and no write to
+// shared memory. A stale entry is simply reloaded from the L2.
+//
+// Each thread keeps one L1 per lru_cache_tiered type; a thread that switches between two
+// caches of the same type starts the L1 over on every switch. An epoch is 32 bits, so an L1
+// entry could only be mistaken for current after exactly 2^32 writes to its keys' epoch.
+
+#if LRUCACHE8_PREFER_CPP11_FUNCTION_DEFAULTS
+template<typename _Key, typename _Val, uint32_t _Sets, uint32_t _Shards = 16, typename _KeyHash = std::hash<_Key>, typename _KeyEqual = std::equal_to<_Key>,
+  uint8_t _L1Ways = 8>
+#else
+template<typename _Key, typename _Val, uint32_t _Sets, uint32_t _Shards = 16, typename _KeyHash = LRU8Hash<_Key>, typename _KeyEqual = LRU8EqualTo<_Key>,
+  uint8_t _L1Ways = 8>
+#endif
+
+class lru_cache_tiered
+{
+  typedef lru_cache_sharded<_Key, _Val, _Sets, _Shards, _KeyHash, _KeyEqual> l2_t;
+
+  struct entry_t
+  {
+    _Val      m_val;
+    uint32_t  m_epoch;                        // of the key when the L2 was read
+
+    entry_t () : m_val (), m_epoch (0) {}
+    entry_t (const _Val &val, uint32_t epoch) : m_val (val), m_epoch (epoch) {}
+  };
+
+  typedef lru_cache8<_Key, entry_t, _KeyHash, _KeyEqual, _L1Ways> l1_t;
+
+  // padded to a line of its own where LRUCACHE8_ALIGN_LINE can not align it (before C++17)
+  struct LRUCACHE8_ALIGN_LINE epoch_t
+  {
+    std::atomic<uint32_t> m_epoch;
+    uint8_t               m_pad [60];
+
+    epoch_t () : m_epoch (0) {}
+  };
+
+  struct local_t
+  {
+    uint64_t  m_owner;                        // id of the cache 'm_l1' holds entries of, 0 == none
+    l1_t      m_l1;
+
+    local_t () : m_owner (0) {}
+  };
+
+public:
+
+  static const uint32_t MAX_SIZE = l2_t::MAX_SIZE;
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  bool read (const _Key &key, _Val *val)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    uint32_t epoch = this->get_epoch (h).load (std::memory_order_acquire);
+
+    l1_t &l1 = this->local ();
+    entry_t *e = l1.find (key, h);
+    if (e && (e->m_epoch == epoch))
+    {
+      *val = e->m_val;
+      return true;
+    }
+
+    // the epoch was read first: if a write lands in between, the entry is already stale
+    if (!m_l2.read (key, val))
+    {
+      return false;
+    }
+
+    l1.write (key, entry_t (*val, epoch), h);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  template<typename _Loader> _Val get_or_load (const _Key &key, _Loader loader)
+  {
+    uint32_t h = (uint32_t) this->m_khash (key);
+    uint32_t epoch = this->get_epoch (h).load (std::memory_order_acquire);
+
+    l1_t &l1 = this->local ();
+    entry_t *e = l1.find (key, h);
+    if (e && (e->m_epoch == epoch))
+    {
+      return e->m_val;
+    }
+
+    bool loaded = false;
+    _Val val = m_l2.get_or_load (key, [&loader, &loaded] (const _Key &k) -> _Val
+    {
+      loaded = true;
+      return loader (k);
+    });
+
+    if (loaded)
+    {
+      // the key was missing from the L2, but L1 copies can outlive the L2's: a fresh load
+      // may differ from them, so it starts a new epoch. Ours is tagged with it unless a
+      // writer bumped the epoch meanwhile.
+      uint32_t prev = this->get_epoch (h).fetch_add (1, std::memory_order_release);
+      epoch = (prev == epoch) ? (epoch + 1) : epoch;
+    }
+
+    l1.write (key, entry_t (val, epoch), h);
+    return val;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void write (const _Key &key, const _Val &val)
+  {
+    m_l2.write (key, val);
+    this->get_epoch ((uint32_t) this->m_khash (key)).fetch_add (1, std::memory_order_release);
+  }
+
+  bool erase (const _Key &key)
+  {
+    bool erased = m_l2.erase (key);
+    this->get_epoch ((uint32_t) this->m_khash (key)).fetch_add (1, std::memory_order_release);
+    return erased;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  void clear ()
+  {
+    m_l2.clear ();
+    for (uint32_t i = 0; i < _Shards; ++i)
+    {
+      m_epoch [i].m_epoch.fetch_add (1, std::memory_order_release);
+    }
+  }
+
+  // replay the L2's buffered hits (see lru_cache_sharded::flush)
+
+  void flush ()
+  {
+    m_l2.flush ();
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache_tiered () : m_epoch (new epoch_t [_Shards]), m_id (next_id ()) {}
+
+  ~lru_cache_tiered ()
+  {
+    delete [] m_epoch;
+  }
+
+private:
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  std::atomic<uint32_t> &get_epoch (uint32_t h)
+  {
+    // as lru_cache_sa picks a set: scramble the low bits up and scale to [0, _Shards)
+    uint32_t m = h * 0x9e3779b1u;
+    return m_epoch [static_cast<uint32_t>((static_cast<uint64_t>(m) * _Shards) >> 32)].m_epoch;
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  l1_t &local ()
+  {
+    static thread_local local_t t_local;
+    if (t_local.m_owner != m_id)
+    {
+      t_local.m_l1.clear ();
+      t_local.m_owner = m_id;
+    }
+
+    return t_local.m_l1;
+  }
+
+  static uint64_t next_id ()
+  {
+    // never reused, so an L1 left behind by a destroyed cache can not be mistaken for ours
+    static std::atomic<uint64_t> s_next (1);
+    return s_next.fetch_add (1, std::memory_order_relaxed);
+  }
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  lru_cache_tiered (const lru_cache_tiered &);
+  lru_cache_tiered &operator= (const lru_cache_tiered &);
+
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////
+
+  l2_t        m_l2;
+  epoch_t    *m_epoch;
+  uint64_t    m_id;
+  _KeyHash    m_khash;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
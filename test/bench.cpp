@@ -0,0 +1,366 @@
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// Build with -DLRUCACHE8_DEBUG_DISABLE_BRANCH_FREE_LRU=1 to measure the branchy LRU search
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+#include "../lru_cache8.h"
+#include "../lru_cache_sa.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+static const uint32_t TRACE_SIZE = 1 << 20;
+static const uint32_t SMALL_CAPACITY = 8;
+static const uint32_t LARGE_SETS = 1024;
+static const uint32_t LARGE_CAPACITY = LARGE_SETS * 8;
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// Baseline: the textbook hash map + linked list LRU
+
+template<typename _Key, typename _Val> class std_lru
+{
+public:
+
+  void write (const _Key &key, const _Val &val)
+  {
+    typename map_t::iterator it = m_map.find (key);
+    if (it != m_map.end ())
+    {
+      it->second->second = val;
+      m_list.splice (m_list.begin (), m_list, it->second);
+      return;
+    }
+
+    if (m_map.size () == m_capacity)
+    {
+      m_map.erase (m_list.back ().first);
+      m_list.pop_back ();
+    }
+
+    m_list.push_front (std::make_pair (key, val));
+    m_map [key] = m_list.begin ();
+  }
+
+  bool read (const _Key &key, _Val *val)
+  {
+    typename map_t::iterator it = m_map.find (key);
+    if (it == m_map.end ())
+    {
+      return false;
+    }
+
+    m_list.splice (m_list.begin (), m_list, it->second);
+    *val = it->second->second;
+    return true;
+  }
+
+  explicit std_lru (size_t capacity) : m_capacity (capacity)
+  {
+    m_map.reserve (capacity);
+  }
+
+private:
+
+  typedef std::list<std::pair<_Key, _Val> > list_t;
+  typedef std::unordered_map<_Key, typename list_t::iterator> map_t;
+
+  list_t  m_list;
+  map_t   m_map;
+  size_t  m_capacity;
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// Access patterns, as indices into a key space
+
+struct rng
+{
+  uint64_t m_state;
+
+  uint32_t next ()
+  {
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 7;
+    m_state ^= m_state << 17;
+    return static_cast<uint32_t>(m_state >> 32);
+  }
+
+  double next_unit ()
+  {
+    return (next () + 0.5) / 4294967296.0;
+  }
+
+  rng () : m_state (0x2545f4914f6cdd1dull) {}
+};
+
+std::vector<uint32_t> make_uniform (uint32_t space)
+{
+  rng r;
+  std::vector<uint32_t> t (TRACE_SIZE);
+  for (uint32_t i = 0; i < TRACE_SIZE; ++i) { t [i] = r.next () % space; }
+  return t;
+}
+
+std::vector<uint32_t> make_zipf (uint32_t space, double alpha)
+{
+  std::vector<double> cdf (space);
+  double sum = 0.0;
+  for (uint32_t i = 0; i < space; ++i)
+  {
+    sum += 1.0 / pow (i + 1.0, alpha);
+    cdf [i] = sum;
+  }
+
+  // scatter ranks over the key space so popular keys are not also numerically adjacent
+  rng r;
+  std::vector<uint32_t> perm (space);
+  for (uint32_t i = 0; i < space; ++i) { perm [i] = i; }
+  for (uint32_t i = space - 1; i > 0; --i) { std::swap (perm [i], perm [r.next () % (i + 1)]); }
+
+  std::vector<uint32_t> t (TRACE_SIZE);
+  for (uint32_t i = 0; i < TRACE_SIZE; ++i)
+  {
+    double u = r.next_unit () * sum;
+    uint32_t rank = static_cast<uint32_t>(std::lower_bound (cdf.begin (), cdf.end (), u) - cdf.begin ());
+    t [i] = perm [std::min (rank, space - 1)];
+  }
+  return t;
+}
+
+std::vector<uint32_t> make_zipf_scan (uint32_t space, double alpha)
+{
+  // every 4th access continues a one-pass scan over the key space
+  std::vector<uint32_t> t = make_zipf (space, alpha);
+  for (uint32_t i = 3; i < TRACE_SIZE; i += 4) { t [i] = (i >> 2) % space; }
+  return t;
+}
+
+std::vector<uint32_t> make_loop (uint32_t length)
+{
+  std::vector<uint32_t> t (TRACE_SIZE);
+  for (uint32_t i = 0; i < TRACE_SIZE; ++i) { t [i] = i % length; }
+  return t;
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// Key types built from a key-space index
+
+struct key_u32
+{
+  typedef uint32_t type;
+  static const char *name () { return "uint32_t"; }
+  void build (uint32_t space) { m_keys.resize (space); for (uint32_t i = 0; i < space; ++i) { m_keys [i] = i * 2654435761u; } }
+  std::vector<uint32_t> m_keys;
+};
+
+struct key_string
+{
+  typedef std::string type;
+  static const char *name () { return "std::string"; }
+  void build (uint32_t space)
+  {
+    // half the keys fit the small-string buffer, half do not
+    m_keys.resize (space);
+    char buf [64];
+    for (uint32_t i = 0; i < space; ++i)
+    {
+      snprintf (buf, sizeof (buf), (i & 1) ? "user/session/%08u/profile" : "k%u", i);
+      m_keys [i] = buf;
+    }
+  }
+  std::vector<std::string> m_keys;
+};
+
+struct key_cstr
+{
+  typedef const char *type;
+  static const char *name () { return "const char *"; }
+  void build (uint32_t space)
+  {
+    m_store.build (space);
+    m_keys.resize (space);
+    for (uint32_t i = 0; i < space; ++i) { m_keys [i] = m_store.m_keys [i].c_str (); }
+  }
+  key_string m_store;
+  std::vector<const char *> m_keys;
+};
+
+struct key_fixed
+{
+  typedef lru8_fixed_string<31> type;
+  static const char *name () { return "fixed<31>"; }
+  void build (uint32_t space)
+  {
+    m_store.build (space);
+    m_keys.assign (m_store.m_keys.begin (), m_store.m_keys.end ());
+  }
+  key_string m_store;
+  std::vector<type> m_keys;
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+static uint64_t g_sink = 0;
+
+template<typename _Cache, typename _Key>
+void run_one (const char *cache_name, const char *key_name, const char *pattern_name, _Cache &cache,
+  const std::vector<_Key> &keys, const std::vector<uint32_t> &trace)
+{
+  typedef std::chrono::steady_clock clock_t;
+
+  // read, fill on miss
+  uint64_t hits = 0;
+  uint32_t val = 0;
+  clock_t::time_point t0 = clock_t::now ();
+  for (uint32_t i = 0; i < TRACE_SIZE; ++i)
+  {
+    const _Key &k = keys [trace [i]];
+    if (cache.read (k, &val))
+    {
+      ++hits;
+      g_sink += val;
+    }
+    else
+    {
+      cache.write (k, trace [i]);
+    }
+  }
+  clock_t::time_point t1 = clock_t::now ();
+
+  // writes only
+  for (uint32_t i = 0; i < TRACE_SIZE; ++i)
+  {
+    cache.write (keys [trace [i]], i);
+  }
+  clock_t::time_point t2 = clock_t::now ();
+
+  double read_ns = std::chrono::duration<double, std::nano> (t1 - t0).count () / TRACE_SIZE;
+  double write_ns = std::chrono::duration<double, std::nano> (t2 - t1).count () / TRACE_SIZE;
+  printf ("%-23s %-13s %-12s %8.2f%% %10.2f %10.2f\n", cache_name, key_name, pattern_name,
+    100.0 * hits / TRACE_SIZE, read_ns, write_ns);
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+template<typename _KeySet> void run_key_type ()
+{
+  typedef typename _KeySet::type key_t;
+
+  struct pattern_t
+  {
+    const char *m_name;
+    std::vector<uint32_t> m_small;
+    std::vector<uint32_t> m_large;
+  };
+
+  // key spaces relative to capacity: uniform over 2x, zipf over 16x (alone and mixed with
+  // a scan), a scan over 4x (defeats LRU) and a loop over 3/4 (fits)
+  pattern_t patterns [5];
+  patterns [0].m_name = "uniform";
+  patterns [0].m_small = make_uniform (SMALL_CAPACITY * 2);
+  patterns [0].m_large = make_uniform (LARGE_CAPACITY * 2);
+  patterns [1].m_name = "zipf-0.99";
+  patterns [1].m_small = make_zipf (SMALL_CAPACITY * 16, 0.99);
+  patterns [1].m_large = make_zipf (LARGE_CAPACITY * 16, 0.99);
+  patterns [2].m_name = "scan";
+  patterns [2].m_small = make_loop (SMALL_CAPACITY * 4);
+  patterns [2].m_large = make_loop (LARGE_CAPACITY * 4);
+  patterns [3].m_name = "loop";
+  patterns [3].m_small = make_loop (SMALL_CAPACITY * 3 / 4);
+  patterns [3].m_large = make_loop (LARGE_CAPACITY * 3 / 4);
+  patterns [4].m_name = "zipf+scan";
+  patterns [4].m_small = make_zipf_scan (SMALL_CAPACITY * 16, 0.99);
+  patterns [4].m_large = make_zipf_scan (LARGE_CAPACITY * 16, 0.99);
+
+  _KeySet keys;
+  keys.build (LARGE_CAPACITY * 16);
+
+  for (uint32_t p = 0; p < 5; ++p)
+  {
+    {
+      lru_cache8<key_t, uint32_t> cache;
+      run_one ("lru_cache8", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_small);
+    }
+    {
+      lru_cache8<key_t, uint32_t, std::hash<key_t>, std::equal_to<key_t> > cache;
+      run_one ("lru_cache8 (std::hash)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_small);
+    }
+    {
+      lru_cache8<key_t, uint32_t, LRU8Hash<key_t>, LRU8EqualTo<key_t>, 8, lru8_stats_none, lru8_replace_plru> cache;
+      run_one ("lru_cache8 (plru)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_small);
+    }
+    {
+      lru_cache8<key_t, uint32_t, LRU8Hash<key_t>, LRU8EqualTo<key_t>, 8, lru8_stats_none, lru8_replace_clock> cache;
+      run_one ("lru_cache8 (clock)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_small);
+    }
+    {
+      lru_cache8<key_t, uint32_t, LRU8Hash<key_t>, LRU8EqualTo<key_t>, 8, lru8_stats_none, lru8_replace_slru> cache;
+      run_one ("lru_cache8 (slru)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_small);
+    }
+    {
+      std_lru<key_t, uint32_t> cache (SMALL_CAPACITY);
+      run_one ("std_lru (8)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_small);
+    }
+    {
+      lru_cache_sa<key_t, uint32_t, LARGE_SETS> cache;
+      run_one ("lru_cache_sa (8192)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_large);
+    }
+    {
+      lru_cache_sa<key_t, uint32_t, LARGE_SETS, LRU8Hash<key_t>, LRU8EqualTo<key_t>,
+        lru_cache8<key_t, uint32_t>, lru8_tinylfu> cache;
+      run_one ("lru_cache_sa (tinylfu)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_large);
+    }
+    {
+      std_lru<key_t, uint32_t> cache (LARGE_CAPACITY);
+      run_one ("std_lru (8192)", _KeySet::name (), patterns [p].m_name, cache, keys.m_keys, patterns [p].m_large);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+int main ()
+{
+  static const char *bitscan [] = { "table", "builtin", "std::countr_zero", "msvc" };
+  printf ("lru search: %s, bit scan: %s\n", LRUCACHE8_DEBUG_DISABLE_BRANCH_FREE_LRU ? "branchy (debug)" : "branch-free", bitscan [LRUCACHE8_BITSCAN]);
+  printf ("%-23s %-13s %-12s %9s %10s %10s\n", "cache", "key", "pattern", "hit", "read ns", "write ns");
+
+  run_key_type<key_u32> ();
+  run_key_type<key_string> ();
+  run_key_type<key_cstr> ();
+  run_key_type<key_fixed> ();
+
+  return (g_sink == 1) ? 1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
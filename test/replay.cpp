@@ -0,0 +1,365 @@
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// Trace replay: hit ratio and ns/op of cache configurations on a recorded key trace.
+//
+//   replay [-t] [-j threads] [-n max_ops] trace
+//
+// A trace is a file of native-endian 64-bit keys, or with -t, text with one key per token
+// (decimal numbers are used as they are, anything else is hashed). Every access is a read,
+// and a miss writes the key, as in bench.cpp. Each configuration is replayed at a range of
+// capacities on a worker pool (one job per configuration and capacity); ns/op is measured
+// while the other jobs run, so use -j 1 for latencies that are not shared with them.
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+#include "../lru_cache8.h"
+#include "../lru_cache_sa.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined (__unix__) || defined (__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define REPLAY_MMAP
+#endif
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+static const uint32_t CAPACITIES [] = { 1 << 9, 1 << 11, 1 << 13, 1 << 15, 1 << 17, 1 << 19 };
+static const uint32_t CAPACITY_COUNT = sizeof (CAPACITIES) / sizeof (CAPACITIES [0]);
+
+typedef std::vector<uint64_t> trace_t;
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// The trace file, mapped read-only (or read into memory where there is no mmap)
+
+class trace_file
+{
+public:
+
+  bool open (const char *path)
+  {
+#ifdef REPLAY_MMAP
+    int fd = ::open (path, O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    struct stat st;
+    if ((fstat (fd, &st) != 0) || (st.st_size == 0))
+    {
+      close (fd);
+      return false;
+    }
+
+    void *base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (base == MAP_FAILED)
+    {
+      return false;
+    }
+
+    m_data = static_cast<const char *>(base);
+    m_size = st.st_size;
+    return true;
+#else
+    FILE *f = fopen (path, "rb");
+    if (!f)
+    {
+      return false;
+    }
+
+    char buf [1 << 16];
+    size_t n;
+    while ((n = fread (buf, 1, sizeof (buf), f)) > 0)
+    {
+      m_copy.append (buf, n);
+    }
+    fclose (f);
+
+    m_data = m_copy.data ();
+    m_size = m_copy.size ();
+    return m_size != 0;
+#endif
+  }
+
+  const char *data () const { return m_data; }
+  size_t size () const { return m_size; }
+
+  trace_file () : m_data (NULL), m_size (0) {}
+
+  ~trace_file ()
+  {
+#ifdef REPLAY_MMAP
+    if (m_data)
+    {
+      munmap (const_cast<char *>(m_data), m_size);
+    }
+#endif
+  }
+
+private:
+
+  const char   *m_data;
+  size_t        m_size;
+#ifndef REPLAY_MMAP
+  std::string   m_copy;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+static void parse_binary (const trace_file &file, size_t max_ops, trace_t &trace)
+{
+  size_t n = std::min (file.size () / sizeof (uint64_t), max_ops);
+  if (n == 0)
+  {
+    return;                                   // shorter than one key
+  }
+
+  trace.resize (n);
+  memcpy (&trace [0], file.data (), n * sizeof (uint64_t));
+}
+
+static void parse_text (const trace_file &file, size_t max_ops, trace_t &trace)
+{
+  const char *p = file.data ();
+  const char *end = p + file.size ();
+  while ((p < end) && (trace.size () < max_ops))
+  {
+    while ((p < end) && isspace (static_cast<unsigned char>(*p)))
+    {
+      ++p;
+    }
+
+    // decimal keys as they are, anything else by FNV-1a
+    uint64_t number = 0, fnv = 0xcbf29ce484222325ull;
+    bool numeric = true;
+    const char *token = p;
+    for (; (p < end) && !isspace (static_cast<unsigned char>(*p)); ++p)
+    {
+      numeric = numeric && (*p >= '0') && (*p <= '9');
+      number = number * 10 + (*p - '0');
+      fnv = (fnv ^ static_cast<unsigned char>(*p)) * 0x100000001b3ull;
+    }
+
+    if (p != token)
+    {
+      trace.push_back (numeric ? number : fnv);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+struct job_t
+{
+  const char   *m_config;
+  uint32_t      m_capacity;
+  void        (*m_run) (const trace_t &, job_t &);
+  double        m_hit;                        // percent
+  double        m_ns;                         // per access
+};
+
+template<uint32_t _Capacity, uint8_t _Ways, template<uint8_t> class _Policy, typename _Admit, typename _Place>
+void replay (const trace_t &trace, job_t &job)
+{
+  typedef lru_cache8<uint64_t, uint32_t, LRU8Hash<uint64_t>, LRU8EqualTo<uint64_t>, _Ways, lru8_stats_none, _Policy> set_t;
+  typedef lru_cache_sa<uint64_t, uint32_t, _Capacity / _Ways, LRU8Hash<uint64_t>, LRU8EqualTo<uint64_t>, set_t, _Admit, _Place> cache_t;
+  typedef std::chrono::steady_clock clock_t;
+
+  cache_t *cache = new cache_t;
+  uint64_t hits = 0;
+  uint32_t val = 0;
+  clock_t::time_point t0 = clock_t::now ();
+  for (size_t i = 0; i < trace.size (); ++i)
+  {
+    if (cache->read (trace [i], &val))
+    {
+      ++hits;
+    }
+    else
+    {
+      cache->write (trace [i], static_cast<uint32_t>(i));
+    }
+  }
+  clock_t::time_point t1 = clock_t::now ();
+  delete cache;
+
+  job.m_hit = 100.0 * hits / trace.size ();
+  job.m_ns = std::chrono::duration<double, std::nano> (t1 - t0).count () / trace.size ();
+}
+
+template<uint8_t _Ways, template<uint8_t> class _Policy, typename _Admit, typename _Place>
+void add_config (std::vector<job_t> &jobs, const char *name)
+{
+  void (*runs [CAPACITY_COUNT]) (const trace_t &, job_t &) =
+  {
+    &replay<1 << 9, _Ways, _Policy, _Admit, _Place>, &replay<1 << 11, _Ways, _Policy, _Admit, _Place>,
+    &replay<1 << 13, _Ways, _Policy, _Admit, _Place>, &replay<1 << 15, _Ways, _Policy, _Admit, _Place>,
+    &replay<1 << 17, _Ways, _Policy, _Admit, _Place>, &replay<1 << 19, _Ways, _Policy, _Admit, _Place>
+  };
+
+  for (uint32_t c = 0; c < CAPACITY_COUNT; ++c)
+  {
+    job_t job = { name, CAPACITIES [c], runs [c], 0.0, 0.0 };
+    jobs.push_back (job);
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+static void print_table (const std::vector<job_t> &jobs, const char *title, bool hit)
+{
+  printf ("\n%-24s", title);
+  for (uint32_t c = 0; c < CAPACITY_COUNT; ++c)
+  {
+    printf (" %9u", CAPACITIES [c]);
+  }
+
+  for (size_t j = 0; j < jobs.size (); ++j)
+  {
+    if ((j % CAPACITY_COUNT) == 0)
+    {
+      printf ("\n%-24s", jobs [j].m_config);
+    }
+    printf (hit ? " %8.2f%%" : " %9.2f", hit ? jobs [j].m_hit : jobs [j].m_ns);
+  }
+  printf ("\n");
+}
+
+static int usage ()
+{
+  fprintf (stderr, "usage: replay [-t] [-j threads] [-n max_ops] trace\n");
+  return 2;
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+int main (int argc, char **argv)
+{
+  bool text = false;
+  uint32_t threads = std::max (std::thread::hardware_concurrency (), 1u);
+  size_t max_ops = static_cast<size_t>(-1);
+  const char *path = NULL;
+
+  for (int a = 1; a < argc; ++a)
+  {
+    std::string arg = argv [a];
+    if (arg == "-t")
+    {
+      text = true;
+    }
+    else if ((arg == "-j") && ((a + 1) < argc))
+    {
+      threads = std::max (atoi (argv [++a]), 1);
+    }
+    else if ((arg == "-n") && ((a + 1) < argc))
+    {
+      max_ops = strtoull (argv [++a], NULL, 10);
+    }
+    else if (!path && (arg [0] != '-'))
+    {
+      path = argv [a];
+    }
+    else
+    {
+      return usage ();
+    }
+  }
+
+  trace_file file;
+  if (!path || !file.open (path))
+  {
+    return path ? (fprintf (stderr, "replay: can not read %s\n", path), 1) : usage ();
+  }
+
+  trace_t trace;
+  text ? parse_text (file, max_ops, trace) : parse_binary (file, max_ops, trace);
+  if (trace.empty ())
+  {
+    fprintf (stderr, "replay: no keys in %s\n", path);
+    return 1;
+  }
+
+  std::vector<job_t> jobs;
+  add_config<8, lru8_replace_lru, lru8_admit_all, lru8_place_one> (jobs, "8-way lru");
+  add_config<8, lru8_replace_plru, lru8_admit_all, lru8_place_one> (jobs, "8-way plru");
+  add_config<8, lru8_replace_clock, lru8_admit_all, lru8_place_one> (jobs, "8-way clock");
+  add_config<8, lru8_replace_slru, lru8_admit_all, lru8_place_one> (jobs, "8-way slru");
+  add_config<8, lru8_replace_lru, lru8_tinylfu, lru8_place_one> (jobs, "8-way lru + tinylfu");
+  add_config<8, lru8_replace_plru, lru8_tinylfu, lru8_place_one> (jobs, "8-way plru + tinylfu");
+  add_config<8, lru8_replace_clock, lru8_tinylfu, lru8_place_one> (jobs, "8-way clock + tinylfu");
+  add_config<8, lru8_replace_slru, lru8_tinylfu, lru8_place_one> (jobs, "8-way slru + tinylfu");
+  add_config<4, lru8_replace_lru, lru8_admit_all, lru8_place_one> (jobs, "4-way lru");
+  add_config<16, lru8_replace_lru, lru8_admit_all, lru8_place_one> (jobs, "16-way lru");
+  add_config<32, lru8_replace_lru, lru8_admit_all, lru8_place_one> (jobs, "32-way lru");
+  add_config<8, lru8_replace_lru, lru8_admit_all, lru8_place_two> (jobs, "8-way lru, two-choice");
+  add_config<8, lru8_replace_lru, lru8_tinylfu, lru8_place_two> (jobs, "8-way lru + tinylfu, 2c");
+
+  // largest capacities first, so the longest jobs do not start last
+  std::vector<size_t> order;
+  for (size_t c = CAPACITY_COUNT; c-- > 0; )
+  {
+    for (size_t j = c; j < jobs.size (); j += CAPACITY_COUNT)
+    {
+      order.push_back (j);
+    }
+  }
+
+  std::atomic<size_t> next (0);
+  std::vector<std::thread> pool;
+  for (uint32_t t = 0; t < std::min<size_t>(threads, jobs.size ()); ++t)
+  {
+    pool.push_back (std::thread ([&] ()
+    {
+      for (size_t n; (n = next.fetch_add (1)) < order.size (); )
+      {
+        job_t &job = jobs [order [n]];
+        job.m_run (trace, job);
+      }
+    }));
+  }
+
+  for (size_t t = 0; t < pool.size (); ++t)
+  {
+    pool [t].join ();
+  }
+
+  printf ("%s: %zu accesses, %zu jobs on %zu threads\n", path, trace.size (), jobs.size (), pool.size ());
+  print_table (jobs, "hit ratio / capacity", true);
+  print_table (jobs, "ns per access", false);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
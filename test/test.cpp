@@ -9,6 +9,20 @@
 //////////////////////////////////////////////////////////////////
 
 #include "../lru_cache8.h"
+#include "../lru_cache_sa.h"
+#if LRUCACHE8_CPP11
+#include "../lru_cache8_concurrent.h"
+#include "../lru_cache_sharded.h"
+#include "../lru_cache_snapshot.h"
+#include "../lru_cache_tiered.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#endif
+#include <assert.h>
+#include <algorithm>
+#include <functional>
+#include <string.h>
 #include <string>
 
 //////////////////////////////////////////////////////////////////
@@ -45,6 +59,453 @@ struct RawStringEqual
 //////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////
 
+struct FakeStorage
+{
+  uint32_t m_loads;
+
+  uint32_t operator() (uint32_t k)
+  {
+    ++m_loads;
+    return k * 3;
+  }
+
+  FakeStorage () : m_loads (0) {}
+};
+
+// get_or_load takes its loader by value: load through a pointer so the test sees the count
+// (std::ref is C++11)
+
+struct LoadFrom
+{
+  FakeStorage *m_storage;
+
+  uint32_t operator() (uint32_t k) const
+  {
+    return (*m_storage) (k);
+  }
+
+  explicit LoadFrom (FakeStorage *storage) : m_storage (storage) {}
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// loads the same text for every key
+
+struct LoadText
+{
+  const char *m_text;
+
+  template<typename _Key> const char *operator() (const _Key &) const
+  {
+    return m_text;
+  }
+
+  explicit LoadText (const char *text) : m_text (text) {}
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// eviction handler and flush sink for write-back tests: keys below 64 only
+
+struct WriteBack
+{
+  uint32_t m_store [64];
+  uint32_t m_writes;
+  uint32_t m_evictions;
+
+  void operator() (uint32_t k, uint32_t v, bool dirty)
+  {
+    ++m_evictions;
+    if (dirty)
+    {
+      (*this) (k, v);
+    }
+  }
+
+  void operator() (uint32_t k, uint32_t v)
+  {
+    m_store [k] = v;
+    ++m_writes;
+  }
+
+  WriteBack () : m_writes (0), m_evictions (0)
+  {
+    memset (m_store, 0, sizeof (m_store));
+  }
+};
+
+// flush takes its sink by value, as get_or_load does its loader (see LoadFrom)
+
+struct FlushTo
+{
+  WriteBack *m_sink;
+
+  void operator() (uint32_t k, uint32_t v) const
+  {
+    (*m_sink) (k, v);
+  }
+
+  explicit FlushTo (WriteBack *sink) : m_sink (sink) {}
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+struct IntHash
+{
+  uint32_t operator() (uint32_t k) const
+  {
+    return k * 0x9e3779b1u;
+  }
+};
+
+// an admission policy that refuses every new key
+
+struct AdmitNone
+{
+  bool admit (uint32_t, uint32_t) const { return false; }
+};
+
+// a degenerate hash: every key gets the same hash, and so the same tag
+
+struct ConstHash
+{
+  size_t operator() (uint32_t) const
+  {
+    return 1;
+  }
+};
+
+// keeps the low 7 hash bits (the way tag) at 0, so every key gets the same tag
+
+struct SameTagHash
+{
+  uint32_t operator() (uint32_t k) const
+  {
+    return k << 7;
+  }
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+// hashes only the low 32 bits, so 64-bit keys that differ above them share a tag
+
+template<typename _Key> struct LowHash
+{
+  uint32_t operator() (_Key k) const
+  {
+    return static_cast<uint32_t>(k) * 0x9e3779b1u;
+  }
+};
+
+// == under another name: keeps lru_cache8 on its stored-hash key path
+
+template<typename _Key> struct PlainEqual
+{
+  bool operator() (const _Key &k1, const _Key &k2) const
+  {
+    return (k1 == k2);
+  }
+};
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+template<uint8_t _Ways> void run_test_ways ()
+{
+  // replay a pseudo-random trace against a reference LRU list (index 0 == MRU)
+  lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, _Ways> cache;
+  uint32_t ref [_Ways];
+  uint32_t ref_size = 0;
+  uint32_t seed = 12345;
+
+  for (uint32_t n = 0; n < 20000; ++n)
+  {
+    seed = seed * 1103515245u + 12345u;
+    uint32_t k = (seed >> 16) % (_Ways + _Ways / 2);
+
+    uint32_t pos = 0;
+    while ((pos < ref_size) && (ref [pos] != k)) { ++pos; }
+
+    uint32_t val = 0;
+    bool hit = cache.read (k, &val);
+    assert (hit == (pos < ref_size));
+    assert (!hit || (val == k));
+
+    if (!hit)
+    {
+      cache.write (k, k);
+      pos = (ref_size < _Ways) ? ref_size++ : (_Ways - 1);
+    }
+
+    for (; pos > 0; --pos) { ref [pos] = ref [pos - 1]; }
+    ref [0] = k;
+
+    // now and then erase the key again: its way must be the next one reused
+    if (((seed >> 8) % 5) == 0)
+    {
+      bool erased = cache.erase (k);
+      assert (erased && (cache.peek (k) == NULL));
+      for (pos = 1; pos < ref_size; ++pos) { ref [pos - 1] = ref [pos]; }
+      --ref_size;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+template<uint8_t _Ways, template<uint8_t> class _Policy> void run_test_policy ()
+{
+  // whatever the policy picks, values stay intact, the way just used is present,
+  // and a full set holds exactly _Ways distinct keys
+  lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, _Ways, lru8_stats_none, _Policy> cache;
+  uint32_t seed = 54321;
+
+  for (uint32_t n = 0; n < 20000; ++n)
+  {
+    seed = seed * 1103515245u + 12345u;
+    uint32_t k = (seed >> 16) % (_Ways * 2);
+
+    uint32_t val = 0;
+    if (cache.read (k, &val))
+    {
+      assert (val == (k * 7));
+    }
+    else
+    {
+      cache.write (k, k * 7);
+    }
+
+    assert (cache.peek (k) != NULL);
+
+    // an erased way is the next victim, so putting the key back evicts nobody
+    if (((n % 7) == 0) && cache.erase (k))
+    {
+      uint32_t before = 0;
+      uint32_t after = 0;
+      for (uint32_t j = 0; j < (_Ways * 2u); ++j) { before += (cache.peek (j) != NULL); }
+      cache.write (k, k * 7);
+      for (uint32_t j = 0; j < (_Ways * 2u); ++j) { after += (cache.peek (j) != NULL); }
+      assert (after == (before + 1));
+    }
+  }
+
+  uint32_t present = 0;
+  for (uint32_t k = 0; k < (_Ways * 2u); ++k)
+  {
+    present += (cache.peek (k) != NULL);
+  }
+  assert (present == _Ways);
+
+  // empty ways fill up before a live entry is evicted, even once an erase has moved the
+  // policy's victim (the CLOCK hand, the PLRU tree) back behind them
+  lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, _Ways, lru8_stats_none, _Policy> fill;
+  for (uint32_t k = 0; k < (_Ways / 2u); ++k)
+  {
+    fill.write (k, k);
+  }
+  fill.erase (1);
+  for (uint32_t k = 100; k <= (100u + _Ways / 2u); ++k)
+  {
+    fill.write (k, k);
+  }
+  present = (fill.peek (1) == NULL);
+  for (uint32_t k = 0; k < (_Ways / 2u); ++k)
+  {
+    present += (fill.peek (k) != NULL);
+  }
+  for (uint32_t k = 100; k <= (100u + _Ways / 2u); ++k)
+  {
+    present += (fill.peek (k) != NULL);
+  }
+  assert (present == _Ways + 1u);
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+#ifdef LRUCACHE8_COROUTINES
+
+struct detached_task
+{
+  struct promise_type
+  {
+    detached_task get_return_object () { return detached_task (); }
+    std::suspend_never initial_suspend () { return std::suspend_never (); }
+    std::suspend_never final_suspend () noexcept { return std::suspend_never (); }
+    void return_void () {}
+    void unhandled_exception () { std::terminate (); }
+  };
+};
+
+typedef lru_cache_sharded<uint32_t, uint32_t, 64, 4> coro_cache_t;
+
+detached_task load_task (coro_cache_t *cache, uint32_t key, uint32_t *loads, uint32_t *out, bool nest)
+{
+  *out = co_await cache->async_get_or_load (key, [=] (uint32_t k)
+  {
+    ++*loads;
+
+    // a second coroutine asking for the same key while this load is in flight
+    // has to suspend on it rather than start its own
+    static uint32_t nested_out = 0;
+    if (nest)
+    {
+      load_task (cache, key, loads, &nested_out, false);
+      assert (nested_out == 0);
+    }
+
+    return k * 2;
+  });
+}
+
+void run_test_coroutines ()
+{
+  coro_cache_t cache;
+  uint32_t loads = 0;
+  uint32_t out = 0;
+
+  load_task (&cache, 5, &loads, &out, true);
+  assert ((out == 10) && (loads == 1));
+
+  load_task (&cache, 5, &loads, &out, false);
+  assert ((out == 10) && (loads == 1));
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+template<typename _Key, uint8_t _Ways> void run_test_packed ()
+{
+  // packed keys (std::equal_to) and stored hashes (PlainEqual) must agree on every access
+  lru_cache8<_Key, uint32_t, LowHash<_Key>, std::equal_to<_Key>, _Ways> packed;
+  lru_cache8<_Key, uint32_t, LowHash<_Key>, PlainEqual<_Key>, _Ways> hashed;
+  uint32_t seed = 777;
+
+  for (uint32_t n = 0; n < 20000; ++n)
+  {
+    seed = seed * 1103515245u + 12345u;
+    uint64_t r = (seed >> 16) % (_Ways * 2u);
+    _Key k = static_cast<_Key>((sizeof (_Key) > 4) ? ((r >> 1) | ((r & 1) << 40)) : r);
+
+    uint32_t a = 0;
+    uint32_t b = 0;
+    bool hit = packed.read (k, &a);
+    assert (hit == hashed.read (k, &b));
+    assert (!hit || (a == b));
+
+    if (!hit)
+    {
+      packed.write (k, n);
+      hashed.write (k, n);
+    }
+    else if ((n % 5) == 0)
+    {
+      assert (packed.erase (k) && hashed.erase (k));
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
+template<uint8_t _Ways> void run_test_matrix ()
+{
+  // the LRU (of all ways, and of a subset) against a plain recency list, through random
+  // set_mru / set_lru, with whichever bit-scan backend this build selected
+  typedef lru8_ways<_Ways> ways_t;
+  typename ways_t::matrix_t m;
+  uint8_t order [_Ways];                      // least recent first
+  uint32_t seed = 4242;
+
+  ways_t::init (m);
+  for (uint8_t i = 0; i < _Ways; ++i)
+  {
+    ways_t::set_mru (m, i);
+    order [i] = i;
+  }
+
+  for (uint32_t n = 0; n < 20000; ++n)
+  {
+    seed = seed * 1103515245u + 12345u;
+    uint8_t w = static_cast<uint8_t>((seed >> 16) % _Ways);
+    uint8_t *at = std::find (order, order + _Ways, w);
+    if ((seed >> 30) != 0)
+    {
+      ways_t::set_mru (m, w);
+      std::rotate (at, at + 1, order + _Ways);
+    }
+    else
+    {
+      ways_t::set_lru (m, w);
+      std::rotate (order, at, at + 1);
+    }
+
+    assert (ways_t::get_lru (m) == order [0]);
+
+    uint32_t rows = (seed * 2654435761u) >> (32 - _Ways);
+    rows |= 1u << w;
+    uint8_t lru = 0;
+    while (!((rows >> order [lru]) & 1u)) { ++lru; }
+    assert (ways_t::get_lru (m, rows) == order [lru]);
+  }
+}
+
+void run_test_bitscan ()
+{
+  for (uint8_t i = 0; i < 8; ++i)
+  {
+    assert (lru8_swar::byte_index (0x80ull << (i * 8)) == i);
+  }
+
+  for (uint8_t i = 0; i < 32; ++i)
+  {
+    assert (lru8_swar::bit_index (1u << i) == i);
+  }
+
+  // every reachable 8-way matrix (one per recency order of the ways) against the branchy search
+  uint8_t p [8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  uint32_t states = 0;
+  do
+  {
+    uint64_t m = lru8_matrix::init ();
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+      m = lru8_matrix::set_mru (m, p [i]);
+    }
+
+    assert (lru8_matrix::get_lru (m) == p [0]);
+    assert (lru8_matrix::get_lru_branchy (m) == p [0]);
+    ++states;
+  }
+  while (std::next_permutation (p, p + 8));
+  assert (states == 40320);
+
+  run_test_matrix<4> ();
+  run_test_matrix<8> ();
+  run_test_matrix<16> ();
+  run_test_matrix<32> ();
+}
+
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////
+
 void run_test ()
 {
   bool ok = false;
@@ -69,6 +530,7 @@ void run_test ()
     cache.write ("six",   (void *) 6);
 
     ok = cache.read ("one", &out);
+    assert (ok && (out == (void *) 1));
 
     cache.write ("seven", (void *) 7);
     cache.write ("eight", (void *) 8);
@@ -88,7 +550,9 @@ void run_test ()
     cache.write ("two", (void *) 2);
 
     ok = cache.read ("one", &out);
+    assert (ok && (out == (void *) 1));
     ok = cache.read ("two", &out);
+    assert (ok && (out == (void *) 2));
   }
 
 #if LRUCACHE8_CPP11
@@ -111,8 +575,11 @@ void run_test ()
     cache.write (3, (void *) 13);
 
     ok = cache.read (0, &out);
+    assert (ok && (out == (void *) 10));
     ok = cache.read (7, &out);
+    assert (!ok);
     ok = cache.read (3, &out);
+    assert (ok && (out == (void *) 13));
   }
 
   {
@@ -123,12 +590,15 @@ void run_test ()
 
     std::string val;
     ok = cache.read ("pi", &val);
+    assert (ok && (val == "3.14"));
 
     val = "3.142";
 
     cache.write ("pi", val);
     ok = cache.read ("pi", &val);
+    assert (ok && (val == "3.142"));
     ok = cache.read ("street", &val);
+    assert (ok && (val == "sesame"));
   }
 
   {
@@ -151,6 +621,1011 @@ void run_test ()
   }
 #endif
 
+  {
+    // identical fingerprints (same low hash bits): every tag matches, and the stored hashes
+    // (PlainEqual keeps the keys off the packed store) must pick the way
+    lru_cache8<uint32_t, uint32_t, SameTagHash, PlainEqual<uint32_t>, 8, lru8_stats_counters> cache;
+
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      cache.write (k << 7, k);
+    }
+
+    uint32_t val = 0;
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      ok = cache.read (k << 7, &val);
+      assert (ok && (val == k));
+    }
+
+    ok = cache.read (8 << 7, &val);
+    assert (!ok);
+
+    cache.write (0, 100);                     // update in place, no eviction
+    ok = cache.read (0, &val);
+    assert (ok && (val == 100));
+    ok = cache.read (1 << 7, &val);
+    assert (ok && (val == 1));
+
+    // the last way written is the last of 8 candidates
+    cache.reset_stats ();
+    ok = cache.read (7 << 7, &val);
+    assert (ok && (val == 7) && (cache.stats ().m_probes [lru8_stats::PROBE_BUCKETS - 1] == 1));
+  }
+
+  {
+    lru_cache8<uint32_t, std::string> cache;
+
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      cache.write (k, std::string (1, (char) ('a' + k)));
+    }
+
+    // peek must not promote: 0 stays LRU and is the next victim
+    const std::string *p = cache.peek (0);
+    assert (p && (*p == "a"));
+    cache.write (8, "i");
+    assert (cache.peek (0) == NULL);
+
+    // find promotes: 1 survives the next write, 2 is evicted instead
+    std::string *f = cache.find (1);
+    assert (f && (*f == "b"));
+    *f = "bb";
+    cache.write (9, "j");
+    assert (cache.peek (1) && (*cache.peek (1) == "bb"));
+    assert (cache.peek (2) == NULL);
+
+#if LRUCACHE8_CPP11
+    // moved-in values keep their heap buffer (no copy)
+    std::string big (64, 'x');
+    const char *buf = big.c_str ();
+    cache.write (10, std::move (big));
+    assert (cache.peek (10)->c_str () == buf);
+
+    assert (cache.emplace (11, 32, 'y') && (cache.peek (11)->size () == 32));
+    assert (cache.emplace (11, "z"));
+    assert (*cache.peek (11) == "z");
+#endif
+  }
+
+  {
+    FakeStorage storage;
+    lru_cache8<uint32_t, uint32_t> cache;
+    lru_cache_sa<uint32_t, uint32_t, 16> cache_sa;
+
+    for (uint32_t n = 0; n < 4; ++n)
+    {
+      assert (cache.get_or_load (7, LoadFrom (&storage)) == 21);
+      assert (cache_sa.get_or_load (7, LoadFrom (&storage)) == 21);
+    }
+
+    assert (storage.m_loads == 2);
+  }
+
+  run_test_ways<4> ();
+  run_test_ways<8> ();
+  run_test_ways<16> ();
+  run_test_ways<32> ();
+
+  run_test_policy<4, lru8_replace_plru> ();
+  run_test_policy<8, lru8_replace_plru> ();
+  run_test_policy<16, lru8_replace_plru> ();
+  run_test_policy<32, lru8_replace_plru> ();
+  run_test_policy<4, lru8_replace_clock> ();
+  run_test_policy<8, lru8_replace_clock> ();
+  run_test_policy<16, lru8_replace_clock> ();
+  run_test_policy<32, lru8_replace_clock> ();
+  run_test_policy<4, lru8_replace_slru> ();
+  run_test_policy<8, lru8_replace_slru> ();
+  run_test_policy<16, lru8_replace_slru> ();
+  run_test_policy<32, lru8_replace_slru> ();
+
+  {
+    assert (sizeof (lru8_replace_plru<8>::state_t) == 1);
+
+    // tree-PLRU never picks the way touched last
+    lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_none, lru8_replace_plru> plru;
+    uint32_t val = 0;
+    for (uint32_t k = 0; k < 64; ++k)
+    {
+      plru.write (k, k);
+      ok = plru.read (k / 2, &val);
+      plru.write (k + 1000, k);
+      assert (!ok || (plru.peek (k / 2) != NULL));
+    }
+
+    // CLOCK: a referenced way gets a second chance, the next unreferenced one goes
+    lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_none, lru8_replace_clock> clock;
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      clock.write (k, k);
+    }
+    ok = clock.read (0, &val);
+    assert (ok);
+    clock.write (8, 8);
+    assert ((clock.peek (0) != NULL) && (clock.peek (1) == NULL));
+
+    // a write refused by admission leaves the reference bits alone: 0 .. 4 stay referenced,
+    // so the next write takes way 5 (a sweep on the refused write would have freed way 0)
+    lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_none, lru8_replace_clock> refused;
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      refused.write (k, k);
+    }
+    for (uint32_t k = 0; k < 4; ++k)
+    {
+      refused.read (k, &val);
+    }
+    assert (!refused.write_admit (100, 100, IntHash () (100), AdmitNone ()));
+    refused.read (4, &val);
+    refused.write (8, 8);
+    assert ((refused.peek (0) != NULL) && (refused.peek (4) != NULL) && (refused.peek (5) == NULL));
+
+    // SLRU: keys hit more than once survive a scan that flushes plain LRU
+    lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_none, lru8_replace_slru> slru;
+    lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8> lru;
+    for (uint32_t k = 0; k < 4; ++k)
+    {
+      slru.write (k, k);
+      lru.write (k, k);
+      slru.read (k, &val);
+      lru.read (k, &val);
+    }
+    for (uint32_t k = 100; k < 200; ++k)
+    {
+      slru.write (k, k);
+      lru.write (k, k);
+    }
+    for (uint32_t k = 0; k < 4; ++k)
+    {
+      assert (slru.peek (k) != NULL);
+      assert (lru.peek (k) == NULL);
+    }
+  }
+
+#if LRUCACHE8_CPP11 && defined (LRUCACHE8_USE_NO_UNIQUE_ADDRESS)
+  {
+    // the default (empty) hasher, equality and policy members are free: 48 bytes of tags,
+    // matrix and keys and 80 of values fill exactly two cache lines, and counting statistics
+    // adds just the counters. A new member, or one that stops being empty, changes this.
+    typedef lru_cache8<uint32_t, lru8_fixed_string<9>, LRU8Hash<uint32_t>, LRU8EqualTo<uint32_t>, 8, lru8_stats_none> plain_t;
+    typedef lru_cache8<uint32_t, lru8_fixed_string<9>, LRU8Hash<uint32_t>, LRU8EqualTo<uint32_t>, 8, lru8_stats_counters> counted_t;
+    static_assert (sizeof (plain_t) == 128, "lru_cache8 layout changed");
+    static_assert (sizeof (counted_t) == ((128 + sizeof (lru8_stats) + alignof (counted_t) - 1) / alignof (counted_t)) * alignof (counted_t), "lru_cache8 layout changed");
+  }
+#endif
+
+  {
+    typedef lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_counters> cache_t;
+    cache_t cache;
+    uint32_t val = 0;
+
+    for (uint32_t k = 0; k < 10; ++k)
+    {
+      cache.write (k, k);                       // 8 inserts into empty ways, 2 evictions
+    }
+    cache.write (9, 90);                        // update
+    ok = cache.read (9, &val);                  // hit
+    assert (ok && (val == 90));
+    ok = cache.read (0, &val);                  // miss (evicted)
+    assert (!ok);
+    assert (cache.peek (5) != NULL);            // hit
+
+    lru8_stats s = cache.stats ();
+    assert ((s.m_hits == 2) && (s.m_misses == 1));
+    assert ((s.m_inserts == 10) && (s.m_updates == 1) && (s.m_evictions == 2));
+    assert ((s.m_probes [0] + s.m_probes [1] + s.m_probes [2] + s.m_probes [3]) == 14);
+
+    // a degenerate hash puts every key on the same tag, so probes walk several ways
+    // (packed keys would compare them all at once)
+    lru_cache8<uint32_t, uint32_t, ConstHash, PlainEqual<uint32_t>, 8, lru8_stats_counters> bad;
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      bad.write (k, k);
+    }
+    bad.reset_stats ();
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      bad.read (k, &val);
+    }
+    assert (bad.stats ().m_probes [3] > 0);
+
+    s.merge (bad.stats ());
+    assert (s.m_hits == 10);
+
+    // the default policy keeps nothing
+    lru_cache8<uint32_t, uint32_t> plain;
+    plain.write (1, 1);
+    assert (plain.stats ().m_inserts == 0);
+
+    lru_cache_sa<uint32_t, uint32_t, 16, IntHash, std::equal_to<uint32_t>, cache_t> cache_sa;
+    for (uint32_t k = 0; k < 64; ++k)
+    {
+      cache_sa.write (k, k);
+      cache_sa.read (k, &val);
+    }
+    s = cache_sa.stats ();
+    assert ((s.m_inserts == 64) && (s.m_hits == 64));
+  }
+
+  {
+    lru8_tinylfu sketch (64);
+    for (uint32_t n = 0; n < 20; ++n)
+    {
+      sketch.record (1);
+      if (n < 3)
+      {
+        sketch.record (2);
+      }
+    }
+
+    // counters saturate at 15; an unseen hash only overestimates through collisions
+    assert ((sketch.estimate (1) == 15) && (sketch.estimate (2) >= 3));
+    assert (sketch.admit (1, 2) && !sketch.admit (2, 1));
+
+    // aging: after 10 * capacity increments every counter is halved
+    for (uint32_t n = 0; n < 640; ++n)
+    {
+      sketch.record (1000 + n);
+    }
+    assert (sketch.estimate (1) < 15);
+
+    // hot keys read over and over, interleaved with a scan of cold keys seen once
+    typedef lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_counters> set_t;
+    lru_cache_sa<uint32_t, uint32_t, 16, IntHash, std::equal_to<uint32_t>, set_t> plain;
+    lru_cache_sa<uint32_t, uint32_t, 16, IntHash, std::equal_to<uint32_t>, set_t, lru8_tinylfu> admitted;
+    uint32_t plain_hits = 0;
+    uint32_t admitted_hits = 0;
+    uint32_t val = 0;
+    for (uint32_t n = 0; n < 20000; ++n)
+    {
+      uint32_t k = (n & 1) ? (n % 64) : (100000 + n);
+      if (plain.read (k, &val)) { ++plain_hits; } else { plain.write (k, k); }
+      if (admitted.read (k, &val)) { ++admitted_hits; } else { admitted.write (k, k); }
+    }
+
+    assert (admitted_hits > (plain_hits + plain_hits / 2));
+    assert (admitted.stats ().m_rejects > 0);
+    assert (plain.stats ().m_rejects == 0);
+
+    // an empty way is always free, whatever the filter says
+    lru_cache8<uint32_t, uint32_t> cache;
+    lru8_tinylfu cold (8);
+    ok = cache.write_admit (5, 50, 5, cold);
+    assert (ok && (*cache.peek (5, 5) == 50));
+  }
+  {
+    typedef lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_counters,
+      lru8_replace_lru, lru8_expiry<lru8_clock_ticks> > cache_t;
+    cache_t cache;
+    uint32_t val = 0;
+
+    // no expiry at all compiles down to the plain node
+    assert (sizeof (lru_cache8<uint32_t, uint32_t>) < sizeof (cache_t));
+
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      cache.write (k, k);                       // never expires
+    }
+    cache.write_ttl (3, 30, 2);                 // rewritten in place, expires in 2 ticks
+    assert (cache.read (3, &val) && (val == 30));
+
+    lru8_clock_ticks::advance (1);
+    assert (cache.peek (3) != NULL);
+    lru8_clock_ticks::advance (1);
+    assert (cache.peek (3) == NULL);
+    ok = cache.read (3, &val);
+    assert (!ok);
+
+    // a new key takes the expired way rather than the LRU one (key 0)
+    cache.write (100, 100);
+    assert (cache.peek (0) != NULL);
+    assert (cache.peek (100) != NULL);
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      assert ((k == 3) == (cache.peek (k) == NULL));
+    }
+
+    // default ttl for writes and loads; an expired key is reloaded into its own way
+    FakeStorage storage;
+    cache.set_ttl (5);
+    assert (cache.get_or_load (200, LoadFrom (&storage)) == 600);  // evicts key 0
+    lru8_clock_ticks::advance (5);
+    assert (cache.peek (200) == NULL);
+    assert (cache.get_or_load (200, LoadFrom (&storage)) == 600);
+    assert (storage.m_loads == 2);
+    for (uint32_t k = 1; k < 8; ++k)
+    {
+      assert ((k == 3) == (cache.peek (k) == NULL));
+    }
+
+    // and through lru_cache_sa
+    lru_cache_sa<uint32_t, uint32_t, 4, IntHash, std::equal_to<uint32_t>, cache_t> cache_sa;
+    cache_sa.set_ttl (3);
+    cache_sa.write (1, 1);
+    cache_sa.write_ttl (2, 2, 0);
+    lru8_clock_ticks::advance (3);
+    assert ((cache_sa.peek (1) == NULL) && (cache_sa.peek (2) != NULL));
+  }
+
+  {
+    lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_counters> cache;
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      cache.write (k, k);
+    }
+
+    assert (cache.erase (5) && !cache.erase (5) && !cache.erase (42));
+    assert (cache.peek (5) == NULL);
+    cache.write (8, 8);                         // takes 5's way, evicts nothing
+    for (uint32_t k = 0; k < 9; ++k)
+    {
+      assert ((k == 5) == (cache.peek (k) == NULL));
+    }
+    assert ((cache.stats ().m_erases == 1) && (cache.stats ().m_evictions == 0));
+
+    lru_cache_sa<uint32_t, uint32_t, 16> cache_sa;
+    cache_sa.write (1, 10);
+    assert (cache_sa.erase (1) && (cache_sa.peek (1) == NULL));
+  }
+
+  {
+    // inline string keys and values: looked up from C strings and std::string, never
+    // allocated, and a key too long to store is never found
+    typedef lru8_fixed_string<23> key_t;
+    typedef lru8_fixed_string<7> val_t;
+    lru_cache8<key_t, val_t> cache;
+    cache.write ("user/1001/profile", "p1001");
+    cache.write (std::string ("user/1002/profile"), val_t ("p1002"));
+    assert (cache.peek ("user/1001/profile") && (cache.peek ("user/1001/profile")->str () == "p1001"));
+    assert (cache.peek (std::string ("user/1002/profile")) && (*cache.peek ("user/1002/profile") == "p1002"));
+    assert (cache.peek ("user/1001/profil") == NULL);
+    assert (cache.peek (key_t ("user/1001/profile\0", 18)) == NULL);
+
+    const char *longer = "user/1003/profile/and/more";
+    assert (!key_t::fits (strlen (longer)) && key_t (longer).too_long ());
+    cache.write (longer, "p1003");
+    assert (cache.peek (longer) == NULL);
+    assert (!(key_t (longer) == key_t (longer)));
+
+    // a too long key or value is refused, not stored: repeating the key leaves the set as it
+    // was, and the value is never read back as a hit
+    lru_cache8<key_t, val_t> full;
+    for (char k = '0'; k < '8'; ++k)
+    {
+      full.write (std::string ("user/") + k, "p");
+    }
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+      full.write (longer, "p1003");
+    }
+    for (char k = '0'; k < '8'; ++k)
+    {
+      assert (full.peek (std::string ("user/") + k) && (*full.peek (std::string ("user/") + k) == "p"));
+    }
+    full.write ("user/1004/profile", "p1004/too/long");
+    assert (full.peek ("user/1004/profile") == NULL);
+    val_t out;
+    assert (!full.read ("user/1004/profile", &out));
+    assert (!full.write_admit (key_t (longer), val_t ("p1003"), LRU8Hash<key_t> () (key_t (longer)), lru8_admit_all ()));
+    assert (!full.write_admit (key_t ("user/0"), val_t ("p1004/too/long"), LRU8Hash<key_t> () (key_t ("user/0")), lru8_admit_all ()));
+    assert (*full.peek ("user/0") == "p");
+
+    // get_or_load returns what it loaded but does not cache it, and emplace refuses it
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+      assert (full.get_or_load (longer, LoadText ("p1003")) == "p1003");
+      assert (full.get_or_load ("user/1004/profile", LoadText ("p1004/too/long")).too_long ());
+#if LRUCACHE8_CPP11
+      assert (!full.emplace (longer, "p1003"));
+      assert (!full.emplace ("user/1004/profile", "p1004/too/long"));
+#endif
+    }
+    for (char k = '0'; k < '8'; ++k)
+    {
+      assert (full.peek (std::string ("user/") + k) && (*full.peek (std::string ("user/") + k) == "p"));
+    }
+    assert (full.peek ("user/1004/profile") == NULL);
+#if LRUCACHE8_CPP11
+    assert (full.emplace ("user/0", "q") && (*full.peek ("user/0") == "q"));
+#endif
+
+    assert ((LRU8Hash<key_t> () (key_t ("abc")) == LRU8Hash<std::string> () (std::string ("abc"))));
+#if LRUCACHE8_CPP11
+    assert (std::is_trivially_copyable<key_t>::value && (sizeof (key_t) == 24));
+#endif
+#if LRUCACHE8_CPP17
+    std::string_view v ("user/1001/profile/extra", 17);
+    assert (cache.peek (v) && (cache.peek (v)->view () == "p1001"));
+#endif
+  }
+
+  {
+    // two-choice placement fits keys that would crowd some sets and leave others idle
+    typedef lru_cache8<uint32_t, uint32_t, LRU8Hash<uint32_t>, LRU8EqualTo<uint32_t>, 8, lru8_stats_counters> set_t;
+    lru_cache_sa<uint32_t, uint32_t, 16, LRU8Hash<uint32_t>, LRU8EqualTo<uint32_t>, set_t> one;
+    lru_cache_sa<uint32_t, uint32_t, 16, LRU8Hash<uint32_t>, LRU8EqualTo<uint32_t>, set_t, lru8_admit_all, lru8_place_two> two;
+    uint32_t kept_one = 0, kept_two = 0, val = 0;
+    for (uint32_t k = 0; k < 96; ++k)
+    {
+      one.write (k, k);
+      two.write (k, k);
+    }
+    for (uint32_t k = 0; k < 96; ++k)
+    {
+      kept_one += one.read (k, &val);
+      kept_two += two.read (k, &val) && (val == k);
+    }
+    assert ((kept_two == 96) && (kept_one < kept_two));
+
+    // one hit or miss per lookup, wherever the key lives
+    lru8_stats st = two.stats ();
+    assert ((st.m_hits == 96) && (st.m_misses == 0) && (st.m_inserts == 96));
+    uint64_t probes = 0;
+    for (uint8_t i = 0; i < lru8_stats::PROBE_BUCKETS; ++i)
+    {
+      probes += st.m_probes [i];
+    }
+    assert (probes == 96 + 96);                 // one per write and read, none for choosing the set
+
+    // rewriting a key updates it in its own set, and lookups find it there
+    for (uint32_t k = 0; k < 96; ++k)
+    {
+      two.write (k, k + 1);
+    }
+    assert (two.stats ().m_inserts == 96);
+    assert (two.peek (7) && (*two.peek (7) == 8) && (*two.find (90) == 91));
+    assert (two.erase (90) && !two.erase (90) && (two.peek (90) == NULL));
+
+    uint32_t keys [4] = { 1, 2, 90, 1000 };
+    uint32_t out [4];
+    uint64_t mask = 0;
+    assert ((two.read_many (keys, 4, out, &mask) == 2) && (mask == 3) && (out [1] == 3));
+
+    FakeStorage storage;
+    assert (two.get_or_load (1000, LoadFrom (&storage)) == 3000);
+    assert (two.get_or_load (1000, LoadFrom (&storage)) == 3000);
+    assert (storage.m_loads == 1);
+
+    two.clear ();
+    assert (two.peek (1) == NULL);
+  }
+
+  {
+    typedef lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_none,
+      lru8_replace_lru, lru8_expiry_none, lru8_evict_to<WriteBack> > cache_t;
+    cache_t cache;
+    WriteBack &store = cache.eviction ();
+    WriteBack sink;
+
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      cache.write (k, k + 1);
+    }
+    for (uint32_t n = 0; n < 10; ++n)
+    {
+      cache.write (3, 30 + n);                  // coalesced in the cache
+    }
+    assert (store.m_evictions == 0);
+
+    // a load evicts key 0, which is written back; the loaded entry is clean
+    FakeStorage storage;
+    assert (cache.get_or_load (10, LoadFrom (&storage)) == 30);
+    assert ((store.m_evictions == 1) && (store.m_writes == 1) && (store.m_store [0] == 1));
+
+    assert (cache.flush (FlushTo (&sink)) == 7);
+    assert ((sink.m_writes == 7) && (sink.m_store [3] == 39) && (sink.m_store [7] == 8));
+    assert (cache.flush (FlushTo (&sink)) == 0);
+
+    // a clean victim (key 1) is handed over but not written
+    cache.write (20, 20);
+    assert ((store.m_evictions == 2) && (store.m_writes == 1));
+
+    // erase and clear drop dirty entries
+    cache.write (5, 50);
+    assert (cache.erase (5));
+    assert (cache.flush (FlushTo (&sink)) == 1);  // key 20
+    cache.write (6, 60);
+    cache.clear ();
+    assert (cache.flush (FlushTo (&sink)) == 0);
+    assert ((store.m_evictions == 2) && (sink.m_writes == 8));
+
+    // lru_cache_sa flushes all of its sets
+    typedef lru_cache8<uint32_t, uint32_t, LRU8Hash<uint32_t>, LRU8EqualTo<uint32_t>, 8, lru8_stats_none,
+      lru8_replace_lru, lru8_expiry_none, lru8_evict_to<WriteBack> > set_t;
+    lru_cache_sa<uint32_t, uint32_t, 16, LRU8Hash<uint32_t>, LRU8EqualTo<uint32_t>, set_t> cache_sa;
+    for (uint32_t k = 0; k < 16; ++k)
+    {
+      cache_sa.write (k, k);
+    }
+    assert (cache_sa.get_or_load (40, LoadFrom (&storage)) == 120);
+    assert (cache_sa.flush (FlushTo (&sink)) == 16);
+    assert (cache_sa.flush (FlushTo (&sink)) == 0);
+
+    // an expired entry that get_or_load reloads in place is handed over first: written back
+    // while dirty, and only handed over once the reload left it clean
+    typedef lru_cache8<uint32_t, uint32_t, IntHash, std::equal_to<uint32_t>, 8, lru8_stats_counters,
+      lru8_replace_lru, lru8_expiry<lru8_clock_ticks>, lru8_evict_to<WriteBack> > timed_t;
+    timed_t timed;
+    WriteBack &timed_store = timed.eviction ();
+    timed.set_ttl (1);
+    timed.write (4, 44);
+    lru8_clock_ticks::advance (1);
+    assert (timed.get_or_load (4, LoadFrom (&storage)) == 12);
+    assert ((timed_store.m_evictions == 1) && (timed_store.m_writes == 1) && (timed_store.m_store [4] == 44));
+    lru8_clock_ticks::advance (1);
+    assert (timed.get_or_load (4, LoadFrom (&storage)) == 12);
+    assert ((timed_store.m_evictions == 2) && (timed_store.m_writes == 1));
+    assert ((timed.stats ().m_evictions == timed_store.m_evictions) && (timed.stats ().m_inserts == 3));
+    assert (timed.flush (FlushTo (&sink)) == 0);
+
+#if LRUCACHE8_CPP11
+    // the evicted key and value are moved out
+    struct Taken
+    {
+      std::string m_key;
+      std::string m_val;
+
+      void operator() (std::string &&k, std::string &&v, bool)
+      {
+        m_key = std::move (k);
+        m_val = std::move (v);
+      }
+    };
+
+    lru_cache8<std::string, std::string, LRU8Hash<std::string>, LRU8EqualTo<std::string>, 4, lru8_stats_none,
+      lru8_replace_lru, lru8_expiry_none, lru8_evict_to<Taken> > names;
+    const char *keys [] = { "one", "two", "three", "four", "five" };
+    for (uint32_t k = 0; k < 5; ++k)
+    {
+      names.write (keys [k], std::string (keys [k]) + " value that does not fit in place");
+    }
+    assert ((names.eviction ().m_key == "one") && (names.eviction ().m_val == "one value that does not fit in place"));
+#endif
+  }
+
+  {
+    // aligned ids and pointers still spread over (nearly) all 128 tags
+    bool tags [128];
+    uint32_t distinct = 0;
+    memset (tags, 0, sizeof (tags));
+    for (uint64_t k = 0; k < 1024; ++k)
+    {
+      uint32_t t = LRU8Hash<uint64_t> () (k << 12) & 0x7f;
+      distinct += !tags [t];
+      tags [t] = true;
+    }
+    assert (distinct > 120);
+
+    static uint64_t slots [64];
+    distinct = 0;
+    memset (tags, 0, sizeof (tags));
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+      uint32_t t = LRU8Hash<uint64_t *> () (&slots [i]) & 0x7f;
+      distinct += !tags [t];
+      tags [t] = true;
+    }
+    assert (distinct > 40);
+
+    // strings hash by content, whatever their length or alignment
+    const char text [] = "xthe quick brown fox jumps over the lazy dog";
+    std::string s (text + 1);
+    assert (LRU8Hash<std::string> () (s) == lru8_hasher::bytes (text + 1, sizeof (text) - 2));
+    for (size_t n = 0; n < s.size (); ++n)
+    {
+      assert (LRU8Hash<std::string> () (s.substr (0, n)) != LRU8Hash<std::string> () (s.substr (0, n + 1)));
+    }
+  }
+
+  run_test_bitscan ();
+
+  {
+    run_test_packed<uint64_t, 4> ();
+    run_test_packed<uint64_t, 8> ();
+    run_test_packed<uint64_t, 16> ();
+    run_test_packed<uint64_t, 32> ();
+    run_test_packed<uint32_t, 8> ();
+    run_test_packed<uint32_t, 32> ();
+    run_test_packed<uint16_t, 8> ();
+
+    // no stored hashes
+    assert (sizeof (lru_cache8<uint64_t, uint32_t>) < sizeof (lru_cache8<uint64_t, uint32_t, LowHash<uint64_t>, PlainEqual<uint64_t> >));
+
+    int items [3] = { 0, 1, 2 };
+    lru_cache8<int *, int> by_ptr;
+    by_ptr.write (&items [0], 0);
+    by_ptr.write (&items [2], 2);
+    assert (by_ptr.peek (&items [1]) == NULL);
+    assert (by_ptr.peek (&items [2]) && (*by_ptr.peek (&items [2]) == 2));
+
+#if LRUCACHE8_CPP11
+    enum class colour : uint8_t { red, green, blue };
+    lru_cache8<colour, int> by_enum;
+    by_enum.write (colour::green, 1);
+    assert (by_enum.peek (colour::red) == NULL);
+    assert (by_enum.peek (colour::green) && (*by_enum.peek (colour::green) == 1));
+#endif
+  }
+
+#if defined (__cpp_aligned_new) && (__cpp_aligned_new >= 201606L)
+  {
+    // every set starts on a cache line, with its tags, replacement state and hashes
+    assert (alignof (lru_cache8<std::string, std::string>) == 64);
+    lru_cache8<uint32_t, uint32_t> *sets = new lru_cache8<uint32_t, uint32_t> [3];
+    assert ((reinterpret_cast<uintptr_t>(&sets [1]) & 63) == 0);
+    delete [] sets;
+  }
+#endif
+
+
+  {
+    lru_cache_sa<uint32_t, uint32_t, 64> cache;
+
+    for (uint32_t k = 0; k < 256; ++k)
+    {
+      cache.write (k, k * 10);
+    }
+
+    uint32_t hits = 0;
+    uint32_t val = 0;
+    for (uint32_t k = 0; k < 256; ++k)
+    {
+      if (cache.read (k, &val))
+      {
+        assert (val == (k * 10));
+        ++hits;
+      }
+    }
+
+    // 512 ways in total: conflict misses only, most of the working set survives
+    assert (hits > 192);
+
+    // batched lookup agrees with one-at-a-time lookup
+    uint32_t keys [100];
+    uint32_t out_many [100];
+    uint64_t mask [2];
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+      keys [i] = i * 3;
+    }
+
+    uint32_t n = cache.read_many (keys, 100, out_many, mask);
+    uint32_t expect = 0;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+      bool hit = (mask [i >> 6] >> (i & 63)) & 1;
+      assert (hit == (cache.peek (keys [i]) != NULL));
+      assert (!hit || (out_many [i] == keys [i] * 10));
+      expect += hit;
+    }
+    assert ((n == expect) && (n > 0));
+
+    cache.clear ();
+    ok = cache.read (0, &val);
+    assert (!ok);
+  }
+
+#if LRUCACHE8_CPP11
+  {
+    // values always encode their key: a torn or mismatched read shows up as a bad pair
+    lru_cache8_concurrent<uint32_t, uint64_t> cache;
+    std::atomic<uint32_t> bad (0);
+    std::atomic<uint32_t> hits (0);
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t)
+    {
+      threads.push_back (std::thread ([&cache, &bad, &hits, t] ()
+      {
+        uint64_t v = 0;
+        for (uint32_t n = 0; n < 20000; ++n)
+        {
+          uint32_t k = (n * 7 + t) % 12;
+          if (cache.read (k, &v))
+          {
+            hits.fetch_add (1, std::memory_order_relaxed);
+            if (v != ((uint64_t) k << 32 | k)) { bad.fetch_add (1, std::memory_order_relaxed); }
+          }
+          else
+          {
+            cache.write (k, (uint64_t) k << 32 | k);
+          }
+        }
+      }));
+    }
+
+    for (size_t t = 0; t < threads.size (); ++t)
+    {
+      threads [t].join ();
+    }
+
+    assert (bad.load () == 0);
+    assert (hits.load () > 0);
+
+    // the reference matrix must still be a valid total order after racing hits
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      cache.write (100 + k, k);
+    }
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      uint64_t v = 0;
+      ok = cache.read (100 + k, &v);
+      assert (ok && (v == k));
+    }
+  }
+
+  {
+    // single set: buffered hits must still steer eviction once replayed
+    lru_cache_sharded<uint32_t, uint32_t, 1, 1> cache;
+
+    for (uint32_t k = 0; k < 8; ++k)
+    {
+      cache.write (k, k);
+    }
+
+    uint32_t v = 0;
+    ok = cache.read (0, &v);
+    assert (ok && (v == 0));
+
+    cache.write (8, 8);                       // replays the hit on 0 first, evicts 1
+
+    ok = cache.read (0, &v);
+    assert (ok);
+    ok = cache.read (1, &v);
+    assert (!ok);
+  }
+
+  {
+    lru_cache_sharded<uint32_t, uint64_t, 256, 8> cache;
+    std::atomic<uint32_t> bad (0);
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t)
+    {
+      threads.push_back (std::thread ([&cache, &bad, t] ()
+      {
+        uint64_t v = 0;
+        for (uint32_t n = 0; n < 50000; ++n)
+        {
+          uint32_t k = (n * 31 + t) % 1024;
+          if (!cache.read (k, &v))
+          {
+            cache.write (k, (uint64_t) k << 32 | k);
+          }
+          else if (v != ((uint64_t) k << 32 | k))
+          {
+            bad.fetch_add (1, std::memory_order_relaxed);
+          }
+        }
+      }));
+    }
+
+    for (size_t t = 0; t < threads.size (); ++t)
+    {
+      threads [t].join ();
+    }
+
+    assert (bad.load () == 0);
+    cache.flush ();
+  }
+
+  {
+    // concurrent misses on one key: one load, everybody gets its result
+    lru_cache_sharded<uint32_t, uint32_t, 64, 4> cache;
+    std::atomic<uint32_t> loads (0);
+    std::atomic<uint32_t> arrived (0);
+    std::atomic<uint32_t> bad (0);
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t)
+    {
+      threads.push_back (std::thread ([&] ()
+      {
+        arrived.fetch_add (1);
+        uint32_t v = cache.get_or_load (42, [&] (uint32_t k)
+        {
+          loads.fetch_add (1);
+          while (arrived.load () < 4) { std::this_thread::yield (); }
+          std::this_thread::sleep_for (std::chrono::milliseconds (50));
+          return k + 1;
+        });
+
+        if (v != 43) { bad.fetch_add (1); }
+      }));
+    }
+
+    for (size_t t = 0; t < threads.size (); ++t)
+    {
+      threads [t].join ();
+    }
+
+    assert (bad.load () == 0);
+    assert (loads.load () == 1);
+  }
+
+  {
+    lru_cache_sharded<uint32_t, uint32_t, 64, 4> cache;
+    uint32_t v = 0;
+
+    cache.write (5, 50);
+    assert (cache.erase (5) && !cache.read (5, &v));
+    assert (!cache.erase (5));
+  }
+
+  {
+    // the L1 never serves a value the L2 has since replaced or dropped
+    lru_cache_tiered<uint32_t, uint32_t, 64, 4> cache;
+    uint32_t v = 0;
+
+    cache.write (1, 10);
+    ok = cache.read (1, &v);                  // fills this thread's L1
+    assert (ok && (v == 10));
+    ok = cache.read (1, &v);                  // L1 hit
+    assert (ok && (v == 10));
+
+    cache.write (1, 11);
+    ok = cache.read (1, &v);
+    assert (ok && (v == 11));
+
+    assert (cache.erase (1));
+    assert (!cache.read (1, &v));
+
+    assert (cache.get_or_load (2, [] (uint32_t k) { return k * 3; }) == 6);
+    assert (cache.get_or_load (2, [] (uint32_t) { return 0u; }) == 6);
+
+    cache.clear ();
+    assert (!cache.read (2, &v));
+
+    // a second cache of the same type takes the L1 over without seeing the first one's entries
+    lru_cache_tiered<uint32_t, uint32_t, 64, 4> other;
+    cache.write (3, 30);
+    ok = cache.read (3, &v);
+    assert (ok && (v == 30));
+    assert (!other.read (3, &v));
+  }
+
+  {
+    // an L1 copy outlives the L2's: once another thread has evicted the key from the L2 and
+    // loaded a new value, this thread's copy is no longer current
+    lru_cache_tiered<uint32_t, uint32_t, 64, 4> cache;
+    uint32_t v = 0;
+
+    assert (cache.get_or_load (2, [] (uint32_t k) { return k * 3; }) == 6);
+    std::thread other ([&cache] ()
+    {
+      for (uint32_t k = 100; k < 2100; ++k)
+      {
+        cache.get_or_load (k, [] (uint32_t n) { return n; });
+      }
+      assert (cache.get_or_load (2, [] (uint32_t) { return 7u; }) == 7);
+    });
+    other.join ();
+
+    ok = cache.read (2, &v);
+    assert (ok && (v == 7));
+  }
+
+  {
+    // once a reader has seen that version n of a key was written, it never reads an older one
+    lru_cache_tiered<uint32_t, uint32_t, 64, 4> cache;
+    std::atomic<uint32_t> published [16];
+    std::atomic<bool> done (false);
+    std::atomic<uint32_t> bad (0);
+
+    for (uint32_t k = 0; k < 16; ++k)
+    {
+      cache.write (k, 0);
+      published [k].store (0);
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 3; ++t)
+    {
+      threads.push_back (std::thread ([&, t] ()
+      {
+        for (uint32_t n = 0; !done.load (); ++n)
+        {
+          uint32_t k = (n * 7 + t) & 15;
+          uint32_t p = published [k].load (std::memory_order_acquire);
+          uint32_t v = 0;
+          if (cache.read (k, &v) && (v < p))
+          {
+            bad.fetch_add (1);
+          }
+        }
+      }));
+    }
+
+    for (uint32_t n = 1; n <= 20000; ++n)
+    {
+      uint32_t k = n & 15;
+      cache.write (k, n);
+      published [k].store (n, std::memory_order_release);
+    }
+
+    done.store (true);
+    for (size_t t = 0; t < threads.size (); ++t)
+    {
+      threads [t].join ();
+    }
+
+    assert (bad.load () == 0);
+  }
+
+  {
+    typedef lru_cache_sa<uint32_t, uint32_t, 64> sa_t;
+    typedef lru8_snapshot<sa_t::set_type> snap_t;
+    const char *path = "lru8_test.snap";
+
+    sa_t cache;
+    for (uint32_t k = 0; k < 256; ++k)
+    {
+      cache.write (k, k * 3);
+    }
+    assert (snap_t::write (path, cache.sets (), sa_t::SET_COUNT));
+
+    snap_t mapped;
+    assert (mapped.map (path, sa_t::SET_COUNT));
+    {
+      sa_t warm (mapped.sets ());
+      for (uint32_t k = 0; k < 256; ++k)
+      {
+        uint32_t a = 0, b = 0;
+        assert (cache.read (k, &a) == warm.read (k, &b));
+        assert (a == b);
+      }
+
+      // copy-on-write: the file keeps the snapshot
+      warm.clear ();
+    }
+
+    sa_t::set_type *sets = new sa_t::set_type [sa_t::SET_COUNT];
+    assert (snap_t::read (path, sets, sa_t::SET_COUNT));
+    assert (memcmp (sets, cache.sets (), sizeof (sa_t::set_type) * sa_t::SET_COUNT) == 0);
+
+    // the set count must match, and a damaged file is refused
+    assert (!snap_t::read (path, sets, sa_t::SET_COUNT / 2));
+    assert (!mapped.map (path, sa_t::SET_COUNT / 2));
+
+    FILE *f = fopen (path, "r+b");
+    fseek (f, 200, SEEK_SET);
+    int c = fgetc (f);
+    fseek (f, 200, SEEK_SET);
+    fputc (c ^ 1, f);
+    fclose (f);
+    assert (!mapped.map (path, sa_t::SET_COUNT));
+    assert (!snap_t::read (path, sets, sa_t::SET_COUNT));
+    uint32_t v = 0;
+    for (uint32_t s = 0; s < sa_t::SET_COUNT; ++s)
+    {
+      for (uint32_t k = 0; k < 256; ++k)
+      {
+        assert (!sets [s].read (k, &v));
+      }
+    }
+    delete [] sets;
+
+    // a single set round-trips too
+    typedef lru_cache8<uint64_t, double> set_t;
+    set_t one, back;
+    one.write (1, 0.5);
+    one.write (2, 0.25);
+    assert (lru8_snapshot<set_t>::write (path, &one, 1));
+    assert (lru8_snapshot<set_t>::read (path, &back, 1));
+    double d = 0;
+    assert (back.read (1, &d) && (d == 0.5));
+    assert (back.read (2, &d) && (d == 0.25));
+
+    remove (path);
+  }
+
+#ifdef LRUCACHE8_COROUTINES
+  run_test_coroutines ();
+#endif
+#endif
+
 #if 0
   {
     struct dumb